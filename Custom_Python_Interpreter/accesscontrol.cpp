@@ -3,11 +3,15 @@
  */
 
 #include "accesscontrol.hpp"
+#include "verifycache.hpp"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <string>
 #include <unistd.h>
+#include <utility>
 
 // you should hide this somehow...
 static const char* const MAGIC_PASSWORD = "monkey123";
@@ -26,15 +30,54 @@ bool checkInteractiveAccess(bool isInteractive)
 }
 
 
-SignatureStatus checkFileSignature(const wchar_t* file)
+/// converts a path for the C API (TODO: Python locale-specific conversion?)
+static std::string toPath(const wchar_t* file)
 {
-    // TODO: Python locale-specific conversion?
     char path[512];
     memset(path, 0, sizeof(path));
     wcstombs(path, file, sizeof(path) - 1);
+    return path;
+}
+
+SignatureStatus checkFileSignature(const wchar_t* file, std::unique_ptr<MappedFile>& standalone)
+{
+    const std::string path = toPath(file);
+
+    // unchanged scripts skip the public key operation (the cache is only opened for signed ones)
+    const Verifier verify = [&path](const bytestring& sig, const Digest& digest) {
+        const VerifyCache cache(VerifyCache::defaultDirectory());
+        if (cache.contains(path.c_str(), digest))
+            return SignatureStatus::VALID;
+        const auto status = verifySignature(sig, digest);
+        if (status == SignatureStatus::VALID)
+            cache.insert(path.c_str(), digest);
+        return status;
+    };
+
+    std::unique_ptr<MappedFile> mapped;
+    try
+    {
+        mapped.reset(new MappedFile(path.c_str()));
+    }
+    catch (std::exception&)
+    {
+        // not a (readable) file -> can't be standalone
+    }
 
-    if (isStandalone(path))
-        return checkStandaloneSignature(path);
+    if (mapped && isStandalone(*mapped))
+    {
+        const auto status = checkStandaloneSignature(*mapped, verify);
+        standalone = std::move(mapped);
+        return status;
+    }
 
-    return checkDetachedSignature(path);
+    return checkDetachedSignature(path.c_str(), verify);
+}
+
+SignatureStatus checkManifest(const wchar_t* file, std::unique_ptr<Manifest>& manifest)
+{
+    const std::string path = toPath(file);
+    const auto slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    return loadManifest(directory.c_str(), manifest);
 }
@@ -4,7 +4,10 @@
 
 #pragma once
 
-#include "signatures.hpp" // for SignatureStatus
+#include "manifest.hpp"   // for Manifest
+#include "signatures.hpp" // for SignatureStatus, MappedFile
+
+#include <memory>
 
 /**
  * Checks whether interactive access is allowed. The user may be queried for a password.
@@ -15,7 +18,17 @@ bool checkInteractiveAccess(bool isInteractive);
 
 /**
  * Checks a file's signature (detached or for standalone scripts).
- * @param[in] file      file path
+ * @param[in] file          file path
+ * @param[out] standalone   the mapped file, if it's a standalone script: its ZIP can be run from
+ *                          there, without reading the file again (must outlive the interpreter)
  * @return the check status
  */
-SignatureStatus checkFileSignature(const wchar_t* file);
+SignatureStatus checkFileSignature(const wchar_t* file, std::unique_ptr<MappedFile>& standalone);
+/**
+ * Loads the manifest of the directory of a script (if there is one).
+ * @param[in] file          script path
+ * @param[out] manifest     the manifest, if it's valid: modules from this directory tree may only
+ *                          be imported if they're listed
+ * @return the check status (unsigned if there is no manifest)
+ */
+SignatureStatus checkManifest(const wchar_t* file, std::unique_ptr<Manifest>& manifest);
@@ -0,0 +1,155 @@
+/**
+ * Batch signing implementation.
+ */
+
+#include "batch.hpp"
+#include "manifest.hpp"
+#include "signatures.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void BatchReport::print(std::ostream& os) const
+{
+    os << files << " files, " << bytes / 1e6 << " MB in " << seconds << " s: "
+       << (seconds > 0 ? files / seconds : 0) << " files/s, "
+       << (seconds > 0 ? bytes / 1e6 / seconds : 0) << " MB/s";
+    if (failures > 0)
+        os << ", " << failures << " failed";
+    os << "\n";
+    if (latencies.empty())
+        return;
+
+    std::vector<double> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&](size_t p) { return sorted[(sorted.size() - 1) * p / 100] * 1e3; };
+    os << "latency per file (ms): p50 " << percentile(50) << ", p90 " << percentile(90)
+       << ", p99 " << percentile(99) << ", max " << sorted.back() * 1e3 << "\n";
+}
+
+void parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& task)
+{
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    // files differ in size: take the next one when done, rather than fixed chunks
+    const auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    jobs = std::max(1u, std::min<unsigned>(jobs, count));
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+BatchReport signFiles(const std::vector<std::string>& files, unsigned jobs, std::ostream& errors)
+{
+    // fail early (and once) on a missing key, rather than for each file
+    sign(Digest());
+
+    BatchReport report;
+    std::vector<uint64_t> sizes(files.size());
+    std::vector<double> latencies(files.size(), -1);
+    std::mutex errorMutex;
+
+    const Clock::time_point start = Clock::now();
+    parallelFor(files.size(), jobs, [&](size_t i) {
+        const Clock::time_point fileStart = Clock::now();
+        try
+        {
+            const MappedFile file(files[i].c_str());
+            writeFile((files[i] + ".signature").c_str(),
+                      sign(digestMemory(file.data(), file.size())));
+            sizes[i] = file.size();
+            latencies[i] = secondsSince(fileStart);
+        }
+        catch (std::exception& exc)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errors << files[i] << ": " << exc.what() << "\n";
+        }
+    });
+    report.seconds = secondsSince(start);
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (latencies[i] < 0)
+        {
+            ++report.failures;
+            continue;
+        }
+        ++report.files;
+        report.bytes += sizes[i];
+        report.latencies.push_back(latencies[i]);
+    }
+    return report;
+}
+
+BatchReport signTree(const char* directory, unsigned jobs)
+{
+    sign(Digest());
+
+    BatchReport report;
+    const Clock::time_point start = Clock::now();
+    const std::vector<std::string> files = listManifestFiles(directory);
+    std::vector<ManifestEntry> entries(files.size());
+    report.latencies.resize(files.size());
+
+    // size and digest of the same mapping: consistent even if the file is being replaced
+    parallelFor(files.size(), jobs, [&](size_t i) {
+        const Clock::time_point fileStart = Clock::now();
+        const std::string path = std::string(directory) + '/' + files[i];
+        try
+        {
+            const MappedFile file(path.c_str());
+            entries[i].path = files[i];
+            entries[i].size = file.size();
+            entries[i].digest = digestMemory(file.data(), file.size());
+        }
+        catch (std::exception& exc)
+        {
+            throw std::runtime_error(path + ": " + exc.what());
+        }
+        report.latencies[i] = secondsSince(fileStart);
+    });
+
+    for (const auto& entry : entries)
+        report.bytes += entry.size;
+    report.files = entries.size();
+    writeManifest(directory, std::move(entries));
+    report.seconds = secondsSince(start);
+    return report;
+}
@@ -0,0 +1,52 @@
+/**
+ * Batch signing: many files at once, hashed and signed by a pool of threads.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// statistics of a batch
+struct BatchReport
+{
+    /// number of signed files
+    size_t files = 0;
+    /// number of failed files (their errors have been reported already)
+    size_t failures = 0;
+    /// total size of the signed files
+    uint64_t bytes = 0;
+    /// wall clock time of the whole batch
+    double seconds = 0;
+    /// time per file (hashing and signing), in seconds
+    std::vector<double> latencies;
+
+    /// prints throughput and latency percentiles
+    void print(std::ostream& os) const;
+};
+
+/**
+ * Runs @a task(0) ... @a task(count - 1) on @a jobs threads.
+ * @throws the first exception thrown by a task, once all threads are done
+ */
+void parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& task);
+
+/**
+ * Creates detached signatures of files. A file that fails is reported to @a errors and doesn't
+ * stop the others.
+ * @param[in] files     file paths
+ * @param[in] jobs      number of threads
+ * @param[in] errors    stream for error messages
+ */
+BatchReport signFiles(const std::vector<std::string>& files, unsigned jobs, std::ostream& errors);
+/**
+ * Creates the manifest of a directory: the files are hashed in parallel, the manifest is signed
+ * and written once.
+ * @param[in] directory the root directory
+ * @param[in] jobs      number of threads
+ * @throws std::runtime_error if a file can't be read (no manifest is written then)
+ */
+BatchReport signTree(const char* directory, unsigned jobs);
@@ -19,6 +19,10 @@
 
 #include <locale.h>
 
+#include <exception>
+#include <memory>
+#include <string>
+
 #include "accesscontrol.hpp"
 
 /* command line options */
@@ -146,9 +150,270 @@ static PyObject* init_mymod()
     return PyModule_Create(&mymod_module);
 }
 
+/// manifest of the main script's directory: only listed modules may be imported from there
+static std::unique_ptr<Manifest> s_manifest;
+
+/// converts the path argument, @return false on errors (with an exception set)
+static bool parsePath(PyObject* args, std::string& path)
+{
+    PyObject* bytes = NULL;
+    if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &bytes))
+        return false;
+    path = PyBytes_AS_STRING(bytes);
+    Py_DECREF(bytes);
+    return true;
+}
+
+static PyObject* signedimport_root(PyObject* self, PyObject* args)
+{
+    (void)self;
+    (void)args;
+    if (!s_manifest)
+        Py_RETURN_NONE;
+    const std::string& root = s_manifest->root();
+    return PyUnicode_DecodeFSDefaultAndSize(root.data(), root.size());
+}
+
+static PyObject* signedimport_locate(PyObject* self, PyObject* args)
+{
+    (void)self;
+    std::string path, relative;
+    if (!parsePath(args, path))
+        return NULL;
+    if (!s_manifest || !s_manifest->locate(path.c_str(), relative))
+        Py_RETURN_NONE;
+    return PyUnicode_DecodeFSDefaultAndSize(relative.data(), relative.size());
+}
+
+static PyObject* signedimport_listed(PyObject* self, PyObject* args)
+{
+    (void)self;
+    std::string relative;
+    if (!parsePath(args, relative))
+        return NULL;
+    return PyBool_FromLong(s_manifest && s_manifest->listed(relative));
+}
+
+static PyObject* signedimport_load(PyObject* self, PyObject* args)
+{
+    (void)self;
+    std::string path;
+    if (!parsePath(args, path))
+        return NULL;
+    if (!s_manifest)
+    {
+        PyErr_SetString(PyExc_ImportError, "no manifest");
+        return NULL;
+    }
+    try
+    {
+        const bytestring content = s_manifest->readVerified(path.c_str());
+        return PyBytes_FromStringAndSize((const char*)content.data(), content.size());
+    }
+    catch (std::exception& exc)
+    {
+        PyErr_SetString(PyExc_ImportError, exc.what());
+        return NULL;
+    }
+}
+
+static PyMethodDef signedimport_methods[] = {
+    { "root", signedimport_root, METH_NOARGS, "Root directory of the manifest." },
+    { "locate", signedimport_locate, METH_VARARGS,
+      "Directory relative to the manifest's root, None if it's not below the root." },
+    { "listed", signedimport_listed, METH_VARARGS,
+      "Is the file (relative to the root) listed in the manifest?" },
+    { "load", signedimport_load, METH_VARARGS, "Read a listed file, checking its digest." },
+    { NULL, NULL, 0, NULL } /* Sentinel */
+};
+
+static struct PyModuleDef signedimport_module = {
+    PyModuleDef_HEAD_INIT, "_signedimport", /* name of module */
+    "Native part of the signed import hook", /* module documentation, may be NULL */
+    -1, signedimport_methods
+};
+
+static PyObject* init_signedimport()
+{
+    return PyModule_Create(&signedimport_module);
+}
+
 static void initModules(void)
 {
     PyImport_AppendInittab("mymod", init_mymod);
+    PyImport_AppendInittab("_signedimport", init_signedimport);
+}
+
+/// Python part of the signed import hook: finds the modules, _signedimport checks them
+static const char* SIGNED_IMPORTER = R"py(
+import os
+import sys
+from importlib.machinery import ModuleSpec
+
+import _signedimport
+
+
+class SignedImporter(object):
+    """meta path finder and loader: below the manifest's root, only listed sources are used"""
+
+    def __init__(self):
+        self._origins = {}
+        # checked content, until it's compiled (get_source() and get_code() use the same)
+        self._sources = {}
+        # path entry -> directory relative to the manifest's root (None: not below the root)
+        self._directories = {}
+
+    def _directory(self, entry):
+        # relative entries depend on the working directory, so they aren't cached
+        if not os.path.isabs(entry):
+            return _signedimport.locate(entry or '.')
+        try:
+            return self._directories[entry]
+        except KeyError:
+            directory = self._directories[entry] = _signedimport.locate(entry)
+            return directory
+
+    def find_spec(self, fullname, path=None, target=None):
+        name = fullname.rpartition('.')[2]
+        for entry in sys.path if path is None else path:
+            if not isinstance(entry, str):
+                continue
+            directory = self._directory(entry)
+            if directory is None:
+                continue
+            # the path based finder must not look there (unlisted sources, bytecode, extensions)
+            sys.path_importer_cache[entry] = None
+            # just lookups in the manifest, the path has been resolved already
+            relative = directory + '/' + name if directory else name
+            location = os.path.join(entry, name)
+            if _signedimport.listed(relative + '/__init__.py'):
+                origin = os.path.join(location, '__init__.py')
+                spec = ModuleSpec(fullname, self, origin=origin, is_package=True)
+                spec.submodule_search_locations = [location]
+            elif _signedimport.listed(relative + '.py'):
+                origin = location + '.py'
+                spec = ModuleSpec(fullname, self, origin=origin)
+            else:
+                continue
+            spec.has_location = True
+            self._origins[fullname] = origin
+            return spec
+        return None
+
+    def create_module(self, spec):
+        return None
+
+    def exec_module(self, module):
+        exec(self.get_code(module.__name__), module.__dict__)
+
+    def is_package(self, fullname):
+        return os.path.basename(self._origins[fullname]) == '__init__.py'
+
+    def get_filename(self, fullname):
+        return self._origins[fullname]
+
+    def _source(self, fullname):
+        try:
+            return self._sources[fullname]
+        except KeyError:
+            source = self._sources[fullname] = _signedimport.load(self._origins[fullname])
+            return source
+
+    def get_source(self, fullname):
+        return self._source(fullname).decode('utf-8')
+
+    def get_code(self, fullname):
+        # compiled from the checked source: bytecode files are neither read nor written
+        source = self._source(fullname)
+        del self._sources[fullname]
+        return compile(source, self._origins[fullname], 'exec', dont_inherit=True)
+
+    def get_data(self, path):
+        return _signedimport.load(path)
+
+
+sys.meta_path.insert(0, SignedImporter())
+# isolated mode leaves out the script's directory, but with a manifest it's safe
+sys.path.insert(0, _signedimport.root())
+)py";
+
+/// @return the path in the locale's encoding (like Python does it)
+static std::string EncodePath(const wchar_t* filename)
+{
+    char* buffer = Py_EncodeLocale(filename, NULL);
+    if (buffer == NULL)
+        return std::string();
+    std::string path = buffer;
+    PyMem_Free(buffer);
+    return path;
+}
+
+/// like run_file(), but runs the checked content of a script listed in s_manifest
+static int RunVerifiedFile(const wchar_t* filename, PyCompilerFlags* p_cf)
+{
+    const std::string path = EncodePath(filename);
+    bytestring content;
+    try
+    {
+        content = s_manifest->readVerified(path.c_str());
+    }
+    catch (std::exception& exc)
+    {
+        fprintf(stderr, "Error: %s\n", exc.what());
+        return 1;
+    }
+
+    PyObject *module, *file, *code, *result;
+    module = PyImport_AddModule("__main__"); /* borrowed */
+    if (module == NULL)
+        goto error;
+    file = PyUnicode_FromWideChar(filename, wcslen(filename));
+    if (file == NULL)
+        goto error;
+    if (PyDict_SetItemString(PyModule_GetDict(module), "__file__", file))
+    {
+        Py_DECREF(file);
+        goto error;
+    }
+    Py_DECREF(file);
+
+    code = Py_CompileStringExFlags(std::string(content.begin(), content.end()).c_str(),
+                                   path.c_str(), Py_file_input, p_cf, -1);
+    if (code == NULL)
+        goto error;
+    result = PyEval_EvalCode(code, PyModule_GetDict(module), PyModule_GetDict(module));
+    Py_DECREF(code);
+    if (result == NULL)
+        goto error;
+    Py_DECREF(result);
+    return 0;
+
+error:
+    PyErr_Print();
+    return 1;
+}
+
+/// installs the signed import hook (after s_manifest has been loaded)
+static int InstallSignedImporter(void)
+{
+    PyObject *globals, *result;
+
+    globals = PyDict_New();
+    if (globals == NULL || PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins()))
+    {
+        Py_XDECREF(globals);
+        PyErr_Print();
+        return -1;
+    }
+    result = PyRun_String(SIGNED_IMPORTER, Py_file_input, globals, globals);
+    Py_DECREF(globals);
+    if (result == NULL)
+    {
+        PyErr_Print();
+        return -1;
+    }
+    Py_DECREF(result);
+    return 0;
 }
 
 static void RunInteractiveHook(void)
@@ -223,6 +488,174 @@ error:
     return 1;
 }
 
+/// Python part of RunMainFromMemory(): an importer for a ZIP in memory
+static const char* MEMORY_IMPORTER = R"py(
+import sys
+import zipfile
+from importlib.machinery import ModuleSpec
+
+
+class MemoryFile(object):
+    """seekable, read-only file over a buffer: only what is read gets copied"""
+
+    def __init__(self, buffer):
+        self._buffer = memoryview(buffer)
+        self._pos = 0
+
+    def seekable(self):
+        return True
+
+    def tell(self):
+        return self._pos
+
+    def seek(self, offset, whence=0):
+        if whence == 1:
+            offset += self._pos
+        elif whence == 2:
+            offset += len(self._buffer)
+        self._pos = max(0, offset)
+        return self._pos
+
+    def read(self, size=-1):
+        end = len(self._buffer)
+        if size is not None and size >= 0:
+            end = min(end, self._pos + size)
+        data = self._buffer[self._pos:end].tobytes()
+        self._pos = max(self._pos, end)
+        return data
+
+
+class MemoryZipImporter(object):
+    """like zipimport.zipimporter, but for a ZIP in memory (source modules only)"""
+
+    def __init__(self, zip, archive, prefix=''):
+        self._zip = zip
+        self._names = set(zip.namelist())
+        self._archive = archive
+        self._prefix = prefix
+
+    def _find(self, fullname):
+        path = self._prefix + fullname.rpartition('.')[2]
+        if path + '/__init__.py' in self._names:
+            return path, path + '/__init__.py'
+        if path + '.py' in self._names:
+            return None, path + '.py'
+        return None, None
+
+    def find_spec(self, fullname, target=None):
+        package, name = self._find(fullname)
+        if name is None:
+            return None
+        spec = ModuleSpec(fullname, self, origin=self._archive + '/' + name,
+                          is_package=package is not None)
+        spec.has_location = True
+        if package is not None:
+            # submodules are found by another importer with the package's prefix
+            location = self._archive + '/' + package
+            importer = MemoryZipImporter(self._zip, self._archive, package + '/')
+            sys.path_importer_cache[location] = importer
+            spec.submodule_search_locations = [location]
+        return spec
+
+    def invalidate_caches(self):
+        pass
+
+    def create_module(self, spec):
+        return None
+
+    def exec_module(self, module):
+        exec(self.get_code(module.__name__), module.__dict__)
+
+    def is_package(self, fullname):
+        return self._find(fullname)[0] is not None
+
+    def get_filename(self, fullname):
+        return self._archive + '/' + self._find(fullname)[1]
+
+    def get_source(self, fullname):
+        return self._zip.read(self._find(fullname)[1]).decode('utf-8')
+
+    def get_code(self, fullname):
+        name = self._find(fullname)[1]
+        if name is None:
+            raise ImportError('not found in ' + self._archive, name=fullname)
+        return compile(self._zip.read(name), self._archive + '/' + name, 'exec',
+                       dont_inherit=True)
+
+    def get_data(self, path):
+        if path.startswith(self._archive + '/'):
+            path = path[len(self._archive) + 1:]
+        return self._zip.read(path)
+
+
+def install(buffer, archive):
+    """makes the ZIP in @a buffer the content of @a archive for the import system"""
+    importer = MemoryZipImporter(zipfile.ZipFile(MemoryFile(buffer)), archive)
+    sys.path_importer_cache[archive] = importer
+)py";
+
+/// like RunMainFromImporter(), but the ZIP is already in memory: the file isn't read again
+static int RunMainFromMemory(const wchar_t* filename, const ByteRange& zip)
+{
+    PyObject *argv0 = NULL, *globals = NULL, *buffer = NULL, *install, *result, *sys_path;
+    int sts;
+
+    argv0 = PyUnicode_FromWideChar(filename, wcslen(filename));
+    if (argv0 == NULL)
+        goto error;
+
+    globals = PyDict_New();
+    if (globals == NULL || PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins()))
+        goto error;
+    result = PyRun_String(MEMORY_IMPORTER, Py_file_input, globals, globals);
+    if (result == NULL)
+        goto error;
+    Py_DECREF(result);
+
+    /* no copy: the buffer refers to the mapped file (see MappedFile for what that means) */
+    buffer = PyMemoryView_FromMemory((char*)zip.data, (Py_ssize_t)zip.size, PyBUF_READ);
+    if (buffer == NULL)
+        goto error;
+
+    /* make the buffer the content of argv0 for the import system */
+    install = PyDict_GetItemString(globals, "install");
+    if (install == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "unable to install the importer");
+        goto error;
+    }
+    result = PyObject_CallFunctionObjArgs(install, buffer, argv0, NULL);
+    if (result == NULL)
+        goto error;
+    Py_DECREF(result);
+    Py_CLEAR(buffer);
+    Py_CLEAR(globals);
+
+    /* as in RunMainFromImporter(): put argv0 in sys.path[0] and import __main__ */
+    sys_path = PySys_GetObject("path");
+    if (sys_path == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "unable to get sys.path");
+        goto error;
+    }
+    if (PyList_SetItem(sys_path, 0, argv0))
+    {
+        argv0 = NULL;
+        goto error;
+    }
+    Py_INCREF(argv0);
+
+    sts = RunModule(L"__main__", 0);
+    return sts != 0;
+
+error:
+    Py_XDECREF(argv0);
+    Py_XDECREF(globals);
+    Py_XDECREF(buffer);
+    PyErr_Print();
+    return 1;
+}
+
 static int run_file(FILE* fp, const wchar_t* filename, PyCompilerFlags* p_cf)
 {
     PyObject *unicode, *bytes = NULL;
@@ -399,6 +832,10 @@ int Py_Main(int argc, wchar_t** argv)
     // initialize our modules
     initModules();
 
+    // a standalone script is mapped once, then checked and run from memory
+    // (declared first: Python refers to it until the interpreter is finalized)
+    std::unique_ptr<MappedFile> script;
+
     Py_SetProgramName(argv[0]);
     // RAII (de)initialization
     Interpreter intp;
@@ -420,9 +857,35 @@ int Py_Main(int argc, wchar_t** argv)
             Py_DECREF(v);
     }
 
+    // whether the main script is covered by the manifest (instead of a signature)
+    bool scriptListed = false;
+
     if (filename)
     {
-        const auto sigStatus = checkFileSignature(filename);
+        auto sigStatus = checkFileSignature(filename, script);
+
+        // modules next to the script are checked against its directory's manifest (a standalone
+        // script imports from its own, already verified ZIP)
+        if (!script)
+        {
+            const auto manifestStatus = checkManifest(filename, s_manifest);
+            if (manifestStatus == SignatureStatus::INVALID)
+            {
+                fprintf(stderr, "Error: invalid manifest for '%ls'\n", filename);
+                return 1;
+            }
+            if (manifestStatus == SignatureStatus::VALID && InstallSignedImporter() != 0)
+                return 1;
+
+            // one signature for the whole tree: the script is checked when it's read
+            if (sigStatus == SignatureStatus::UNSIGNED && s_manifest &&
+                s_manifest->contains(EncodePath(filename).c_str()))
+            {
+                sigStatus = SignatureStatus::VALID;
+                scriptListed = true;
+            }
+        }
+
         if (sigStatus == SignatureStatus::INVALID)
         {
             fprintf(stderr, "Error: invalid signature for '%ls'\n", filename);
@@ -458,7 +921,12 @@ int Py_Main(int argc, wchar_t** argv)
 
         if (filename != NULL)
         {
-            sts = RunMainFromImporter(filename);
+            if (script)
+                sts = RunMainFromMemory(filename, standaloneZip(*script));
+            else if (scriptListed)
+                sts = RunVerifiedFile(filename, &cf);
+            else
+                sts = RunMainFromImporter(filename);
         }
 
         if (sts == -1 && filename != NULL)
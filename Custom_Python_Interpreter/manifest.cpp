@@ -0,0 +1,276 @@
+/**
+ * Signed manifest implementation.
+ */
+
+#include "manifest.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+const char* const MANIFEST_FILE = "mypy.manifest";
+
+/// magic of manifest files
+static const char MANIFEST_MAGIC[] = "**MYMF**";
+static constexpr size_t MANIFEST_MAGIC_SIZE = 8;
+
+/// path offset, path size, file size, digest
+static constexpr size_t ENTRY_SIZE = 3 * 8 + sizeof(Digest);
+
+static void appendU64(bytestring& out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        out += (unsigned char)(value >> (8 * i));
+}
+
+static uint64_t readU64(const unsigned char* in)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i)
+        value = value << 8 | in[i];
+    return value;
+}
+
+/// @return the canonical path (symbolic links resolved), or an empty string on errors
+static std::string canonicalPath(const char* path)
+{
+    char buffer[PATH_MAX];
+    if (!realpath(path, buffer))
+        return std::string();
+    return buffer;
+}
+
+/// collects the regular files below @a dir, relative to the root
+static void listFiles(const std::string& dir, const std::string& prefix,
+                      std::vector<std::string>& files)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        throw std::runtime_error(dir + ": " + strerror(errno));
+
+    std::vector<std::string> names;
+    while (const dirent* entry = readdir(d))
+    {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            names.push_back(entry->d_name);
+    }
+    closedir(d);
+
+    for (const auto& name : names)
+    {
+        struct stat st;
+        const std::string path = dir + '/' + name;
+        if (lstat(path.c_str(), &st) != 0)
+            throw std::runtime_error(path + ": " + strerror(errno));
+
+        if (S_ISDIR(st.st_mode) && name != "__pycache__")
+            listFiles(path, prefix + name + '/', files);
+        else if (S_ISREG(st.st_mode))
+            files.push_back(prefix + name);
+    }
+}
+
+std::vector<std::string> listManifestFiles(const char* directory)
+{
+    std::vector<std::string> files;
+    listFiles(directory, std::string(), files);
+    files.erase(std::remove(files.begin(), files.end(), std::string(MANIFEST_FILE)), files.end());
+    return files;
+}
+
+void writeManifest(const char* directory, std::vector<ManifestEntry> entries)
+{
+    // same order as the binary search: std::string compares like memcmp()
+    std::sort(entries.begin(), entries.end(),
+              [](const ManifestEntry& a, const ManifestEntry& b) { return a.path < b.path; });
+
+    bytestring table;
+    appendU64(table, entries.size());
+    uint64_t pathOffset = 0;
+    for (const auto& entry : entries)
+    {
+        appendU64(table, pathOffset);
+        appendU64(table, entry.path.size());
+        appendU64(table, entry.size);
+        table.append(entry.digest.data(), entry.digest.size());
+        pathOffset += entry.path.size();
+    }
+    for (const auto& entry : entries)
+        table.append((const unsigned char*)entry.path.data(), entry.path.size());
+
+    const bytestring signature = sign(digestMemory(table.data(), table.size()));
+    const uint32_t signatureSize = signature.size();
+
+    bytestring manifest((const unsigned char*)MANIFEST_MAGIC, MANIFEST_MAGIC_SIZE);
+    for (int i = 0; i < 4; ++i)
+        manifest += (unsigned char)(signatureSize >> (8 * i));
+    manifest += signature;
+    manifest += table;
+    writeFile((std::string(directory) + '/' + MANIFEST_FILE).c_str(), manifest);
+}
+
+Manifest::Manifest(std::string root, bytestring table)
+    : m_root(std::move(root)), m_table(std::move(table)), m_count(0)
+{
+    if (m_table.size() < 8)
+        throw std::runtime_error("manifest too short");
+    const uint64_t count = readU64(m_table.data());
+    if (count > (m_table.size() - 8) / ENTRY_SIZE)
+        throw std::runtime_error("manifest too short");
+    m_count = count;
+
+    // all paths must be within the table, so the lookup doesn't need to check them
+    const size_t pathsSize = m_table.size() - 8 - m_count * ENTRY_SIZE;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        const unsigned char* entry = m_table.data() + 8 + i * ENTRY_SIZE;
+        const uint64_t offset = readU64(entry);
+        const uint64_t size = readU64(entry + 8);
+        if (offset > pathsSize || size > pathsSize - offset)
+            throw std::runtime_error("invalid path in manifest");
+    }
+}
+
+std::string Manifest::relativePath(const char* path) const
+{
+    std::string relative;
+    locate(path, relative);
+    return relative;
+}
+
+const unsigned char* Manifest::find(const std::string& path) const
+{
+    const unsigned char* entries = m_table.data() + 8;
+    const unsigned char* paths = entries + m_count * ENTRY_SIZE;
+
+    size_t first = 0;
+    size_t count = m_count;
+    while (count > 0)
+    {
+        const size_t half = count / 2;
+        const unsigned char* entry = entries + (first + half) * ENTRY_SIZE;
+        const size_t size = readU64(entry + 8);
+        int cmp = memcmp(paths + readU64(entry), path.data(), std::min(size, path.size()));
+        if (cmp == 0)
+            cmp = size < path.size() ? -1 : (size > path.size() ? 1 : 0);
+
+        if (cmp < 0)
+        {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else if (cmp > 0)
+            count = half;
+        else
+            return entry;
+    }
+    return nullptr;
+}
+
+bool Manifest::locate(const char* path, std::string& relative) const
+{
+    const std::string canonical = canonicalPath(path);
+    relative.clear();
+    if (canonical == m_root)
+        return true;
+    if (canonical.size() <= m_root.size() || canonical.compare(0, m_root.size(), m_root) != 0 ||
+        canonical[m_root.size()] != '/')
+        return false;
+    relative = canonical.substr(m_root.size() + 1);
+    return true;
+}
+
+bool Manifest::contains(const char* path) const
+{
+    const std::string relative = relativePath(path);
+    return !relative.empty() && find(relative);
+}
+
+bytestring Manifest::readVerified(const char* path) const
+{
+    const std::string relative = relativePath(path);
+    const unsigned char* entry = relative.empty() ? nullptr : find(relative);
+    if (!entry)
+        throw std::runtime_error(std::string(path) + " is not in the manifest");
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(std::string(path) + ": " + strerror(errno));
+
+    // most modifications change the size: no need to read the file then
+    const uint64_t size = readU64(entry + 16);
+    struct stat st;
+    bytestring content;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size == size)
+    {
+        // read once, so the checked content is the one that is used
+        content.resize(size);
+        size_t done = 0;
+        while (done < size)
+        {
+            const ssize_t n = read(fd, &content[done], size - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        content.resize(done);
+    }
+    close(fd);
+
+    const Digest digest = digestMemory(content.data(), content.size());
+    if (content.size() != size || memcmp(digest.data(), entry + 24, digest.size()) != 0)
+        throw std::runtime_error(std::string(path) + " has been modified");
+    return content;
+}
+
+SignatureStatus loadManifest(const char* directory, std::unique_ptr<Manifest>& manifest)
+{
+    const std::string root = canonicalPath(directory);
+    if (root.empty())
+        return SignatureStatus::UNSIGNED;
+
+    const std::string manifestPath = root + '/' + MANIFEST_FILE;
+    struct stat st;
+    if (stat(manifestPath.c_str(), &st) != 0)
+        return errno == ENOENT ? SignatureStatus::UNSIGNED : SignatureStatus::INVALID;
+
+    try
+    {
+        // verify exactly what is used below
+        const bytestring content = readFile(manifestPath.c_str());
+        const size_t headerSize = MANIFEST_MAGIC_SIZE + 4;
+        if (content.size() < headerSize ||
+            memcmp(content.data(), MANIFEST_MAGIC, MANIFEST_MAGIC_SIZE) != 0)
+            return SignatureStatus::INVALID;
+
+        const unsigned char* size = content.data() + MANIFEST_MAGIC_SIZE;
+        const size_t signatureSize = size[0] | size[1] << 8 | size[2] << 16 | (size_t)size[3] << 24;
+        if (signatureSize > content.size() - headerSize)
+            return SignatureStatus::INVALID;
+
+        const bytestring signature = content.substr(headerSize, signatureSize);
+        bytestring table = content.substr(headerSize + signatureSize);
+        if (verifySignature(signature, digestMemory(table.data(), table.size())) !=
+            SignatureStatus::VALID)
+            return SignatureStatus::INVALID;
+
+        manifest.reset(new Manifest(root, std::move(table)));
+    }
+    catch (std::exception&)
+    {
+        return SignatureStatus::INVALID;
+    }
+    return SignatureStatus::VALID;
+}
@@ -0,0 +1,111 @@
+/**
+ * Signed manifests: one signature for a whole tree of scripts.
+ *
+ * The manifest of a directory ("mypy.manifest") is a table of all files below it: path, size
+ * and SHA-256 digest, sorted by path. Its signature is checked once, when it's loaded. Files
+ * are checked when they're read for the first time, which then only takes a lookup (binary
+ * search in the table) and a digest comparison.
+ *
+ * File format (integers are little-endian):
+ *  - magic "**MYMF**", signature size (u32), signature of the rest (RSA, like detached ones)
+ *  - number of entries (u64)
+ *  - entries: path offset, path size, file size (u64 each), SHA-256 digest (32 bytes)
+ *  - the paths (relative to the directory, '/' separated, not terminated)
+ */
+
+#pragma once
+
+#include "signatures.hpp" // for Digest, SignatureStatus
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// name of the manifest file in the root directory
+extern const char* const MANIFEST_FILE;
+
+/// one file of a manifest
+struct ManifestEntry
+{
+    /// relative to the root directory
+    std::string path;
+    uint64_t size;
+    Digest digest;
+};
+
+/**
+ * Lists the files that belong into the manifest of a directory: all files below it, except
+ * symbolic links, __pycache__ directories and the manifest itself.
+ * @param[in] directory     the root directory
+ * @return the paths, relative to @a directory
+ */
+std::vector<std::string> listManifestFiles(const char* directory);
+/**
+ * Signs and writes the manifest of a directory (atomically).
+ * @param[in] directory     the root directory
+ * @param[in] entries       all files, in any order
+ */
+void writeManifest(const char* directory, std::vector<ManifestEntry> entries);
+
+/// a verified manifest
+class Manifest
+{
+public:
+    /**
+     * @param[in] root      the (canonical) root directory
+     * @param[in] table     the signed part: the number of entries, the entries and the paths
+     *                      (a copy: a mapping could still change after the signature check)
+     * @throws std::runtime_error if the table is malformed
+     */
+    Manifest(std::string root, bytestring table);
+
+    const std::string& root() const { return m_root; }
+    /// number of listed files
+    size_t size() const { return m_count; }
+
+    /**
+     * @param[in] path      directory path
+     * @param[out] relative its canonical path relative to the root (empty for the root itself)
+     * @return whether @a path is the root or below it (i.e. whether only listed files may be
+     *         used from there)
+     */
+    bool locate(const char* path, std::string& relative) const;
+    /**
+     * @param[in] path      file path
+     * @return whether the file is listed
+     */
+    bool contains(const char* path) const;
+    /**
+     * Like contains(), but without resolving the path (i.e. without any system calls).
+     * @param[in] relative  canonical path relative to the root, '/' separated
+     * @return whether the file is listed
+     */
+    bool listed(const std::string& relative) const { return find(relative) != nullptr; }
+    /**
+     * Reads a listed file and checks its size and digest. The returned content is the checked
+     * one, even if the file is replaced in the meantime.
+     * @param[in] path      file path
+     * @return the file's content
+     * @throws std::runtime_error if the file isn't listed, can't be read or has been modified
+     */
+    bytestring readVerified(const char* path) const;
+
+private:
+    /// canonical path relative to the root, empty if it's not below the root
+    std::string relativePath(const char* path) const;
+    /// binary search, @return the entry of @a path, or nullptr
+    const unsigned char* find(const std::string& path) const;
+
+    std::string m_root;
+    bytestring m_table;
+    size_t m_count;
+};
+
+/**
+ * Loads the manifest of a directory and checks its signature.
+ * @param[in] directory     the root directory
+ * @param[out] manifest     the manifest, if it's valid
+ * @return valid/invalid, or unsigned if there is no manifest
+ */
+SignatureStatus loadManifest(const char* directory, std::unique_ptr<Manifest>& manifest);
@@ -2,19 +2,92 @@
  * Digitally signs scripts.
  *  # sign foo.py
  *  # sign --iszip foo.zip
+ *  # sign --manifest foo/
+ *  # sign --batch [--jobs=N] [--list=FILE] foo.py bar/
  */
 
+#include "batch.hpp"
+#include "manifest.hpp"
 #include "signatures.hpp"
 
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
 #include <vector>
 
+/// @return whether @a path ends with @a suffix
+static bool endsWith(const std::string& path, const char* suffix)
+{
+    const size_t size = strlen(suffix);
+    return path.size() >= size && path.compare(path.size() - size, size, suffix) == 0;
+}
+
+/// upper limit of --jobs: signing is CPU-bound, more threads only contend for the cores
+static const unsigned long MAX_JOBS = 256;
+
+/// @return the number of --jobs=N, or 0 if @a value isn't a number in 1 ... MAX_JOBS
+static unsigned parseJobs(const char* value)
+{
+    // strtoul() would accept leading whitespace and signs ("-1" wraps around)
+    if (*value < '0' || *value > '9')
+        return 0;
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long jobs = strtoul(value, &end, 10);
+    if (errno != 0 || *end != '\0' || jobs > MAX_JOBS)
+        return 0;
+    return (unsigned)jobs;
+}
+
+/// adds the files of a batch: directories are expanded (without existing signatures)
+static void addBatchFiles(const std::string& path, std::vector<std::string>& files)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        files.push_back(path);
+        return;
+    }
+    for (const auto& file : listManifestFiles(path.c_str()))
+    {
+        if (!endsWith(file, ".signature"))
+            files.push_back(path + '/' + file);
+    }
+}
+
+/// reads one path per line, from stdin for "-"
+static void readBatchList(const char* listFile, std::vector<std::string>& files)
+{
+    std::ifstream list;
+    if (strcmp(listFile, "-") != 0)
+    {
+        list.open(listFile);
+        if (!list.is_open())
+            throw std::runtime_error(std::string(listFile) + ": " + strerror(errno));
+    }
+    std::istream& is = list.is_open() ? list : std::cin;
+
+    std::string line;
+    while (std::getline(is, line))
+    {
+        if (!line.empty())
+            addBatchFiles(line, files);
+    }
+}
+
 int main(int argc, const char** argv)
 {
     std::vector<const char*> args;
     bool iszip = false;
+    bool ismanifest = false;
+    bool isbatch = false;
+    const char* listFile = nullptr;
+    unsigned jobs = std::thread::hardware_concurrency();
     bool help = false;
     bool error = false;
 
@@ -25,6 +98,18 @@ int main(int argc, const char** argv)
         {
             if (strcmp(arg, "--iszip") == 0)
                 iszip = true;
+            else if (strcmp(arg, "--manifest") == 0)
+                ismanifest = true;
+            else if (strcmp(arg, "--batch") == 0)
+                isbatch = true;
+            else if (strncmp(arg, "--jobs=", 7) == 0)
+            {
+                jobs = parseJobs(arg + 7);
+                if (jobs == 0)
+                    error = true;
+            }
+            else if (strncmp(arg, "--list=", 7) == 0)
+                listFile = arg + 7;
             else if (strcmp(arg, "--help") == 0)
                 help = true;
             else
@@ -35,24 +120,47 @@ int main(int argc, const char** argv)
             args.push_back(arg);
         }
     }
-    if (args.size() != 1)
+    if (iszip + ismanifest + isbatch > 1)
         error = true;
+    else if (isbatch)
+        error |= args.empty() && !listFile;
+    else
+        error |= args.size() != 1 || listFile;
 
     if (error || help)
     {
-        std::cerr << "usage: sign [--iszip] INFILE\n";
+        std::cerr << "usage: sign [--iszip] INFILE\n"
+                     "       sign --manifest [--jobs=N] DIRECTORY\n"
+                     "       sign --batch [--jobs=N] [--list=FILE] [FILE|DIRECTORY]...\n";
         return (int)error;
     }
-    const char* infile = args[0];
+    if (jobs == 0) // unknown number of cores
+        jobs = 1;
 
     try
     {
+        if (isbatch)
+        {
+            std::vector<std::string> files;
+            if (listFile)
+                readBatchList(listFile, files);
+            for (const char* arg : args)
+                addBatchFiles(arg, files);
+
+            const BatchReport report = signFiles(files, jobs, std::cerr);
+            report.print(std::cerr);
+            return report.failures > 0;
+        }
+
+        const char* infile = args[0];
         if (iszip)
         {
             std::string outfile = infile;
             outfile += ".standalone";
             makeStandalone(infile, outfile.c_str());
         }
+        else if (ismanifest)
+            signTree(infile, jobs).print(std::cerr);
         else
             createDetachedSignature(infile);
         return 0;
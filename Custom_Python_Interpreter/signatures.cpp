@@ -4,10 +4,21 @@
 
 #include "signatures.hpp"
 
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
+#include <openssl/bio.h>
+#include <openssl/evp.h>
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
 
@@ -15,16 +26,16 @@
 static const char* const PRIVATE_KEY_FILE = "privkey.pem";
 
 /// public key file *content*: compiled into the executable to avoid additional files
-static const char PUBLIC_KEY[] = "\
------BEGIN PUBLIC KEY-----\
-MIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKCAQEAyRyx68XFJ9XaJoRd541y\
-A5RyyemegMCn1/GOg0nTJzyXmSqAzQOJll9nSXwRvZxoSflW96S3vH3Tx0tTnPfJ\
-HDDV5cpWqGLdO0zgGq4Uy7AZz0qd71aqftyFCWf1koM17VzcqJ0S+70tnSEaAs2I\
-UYIftOcPgIy/kelekXOpEEKZdyl7rLpyv+CGCd+YOn5CD8SnC1zYB3aVkwP1oGd2\
-Ucm73MA13oMPyK4HWfi9WPnFfrPg/i90rFDOUMsIQuK6lQgzvzo+pxfyxZ4uyp0E\
-T1v6zWKWdXEpbcoMpa0pXmQ6ojNfY3E2FvPWo76vYI3PFr7/T5lIKXHw6GviJ6ft\
-qwIDAQAB\
------END PUBLIC KEY-----";
+static const char PUBLIC_KEY[] =
+    "-----BEGIN PUBLIC KEY-----\n"
+    "MIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKCAQEAyRyx68XFJ9XaJoRd541y\n"
+    "A5RyyemegMCn1/GOg0nTJzyXmSqAzQOJll9nSXwRvZxoSflW96S3vH3Tx0tTnPfJ\n"
+    "HDDV5cpWqGLdO0zgGq4Uy7AZz0qd71aqftyFCWf1koM17VzcqJ0S+70tnSEaAs2I\n"
+    "UYIftOcPgIy/kelekXOpEEKZdyl7rLpyv+CGCd+YOn5CD8SnC1zYB3aVkwP1oGd2\n"
+    "Ucm73MA13oMPyK4HWfi9WPnFfrPg/i90rFDOUMsIQuK6lQgzvzo+pxfyxZ4uyp0E\n"
+    "T1v6zWKWdXEpbcoMpa0pXmQ6ojNfY3E2FvPWo76vYI3PFr7/T5lIKXHw6GviJ6ft\n"
+    "qwIDAQAB\n"
+    "-----END PUBLIC KEY-----\n";
 
 static constexpr size_t HEADER_MAGIC_SIZE = 8;
 
@@ -33,6 +44,12 @@ static const char HEADER_MAGIC[HEADER_MAGIC_SIZE + 1] = "**MYPY**";
 
 static constexpr size_t SIGNATURE_SIZE = 256;
 
+/// scripts are hashed in chunks of this size
+static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+/// the first line of standalone scripts
+static const char SHEBANG[] = "#!/usr/bin/env mypy\n";
+
 /**
  * Stand alone script header format: consists of a simple magic, identifying the file type,
  * and a signature.
@@ -44,19 +61,88 @@ struct StandaloneHeader
     unsigned char signature[SIGNATURE_SIZE];
 };
 
+MappedFile::MappedFile(const char* file) : m_data(nullptr), m_size(0)
+{
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        const int err = errno;
+        close(fd);
+        throw std::runtime_error(err ? strerror(err) : "not a regular file");
+    }
+
+    // an empty file can't be mapped, but doesn't need to be
+    if (st.st_size > 0)
+    {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            const int err = errno;
+            close(fd);
+            throw std::runtime_error(strerror(err));
+        }
+        m_data = static_cast<const unsigned char*>(data);
+        m_size = st.st_size;
+    }
+    // the mapping stays valid without the descriptor
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+}
+
+/// @return the start of the header behind the shebang line, or nullptr (may be truncated!)
+static const unsigned char* findHeader(const MappedFile& file)
+{
+    if (!file.data())
+        return nullptr;
+
+    // skip the first line, it's the shebang
+    const void* newline = memchr(file.data(), '\n', file.size());
+    if (!newline)
+        return nullptr;
+
+    const unsigned char* header = static_cast<const unsigned char*>(newline) + 1;
+    const size_t rest = file.data() + file.size() - header;
+    if (rest < HEADER_MAGIC_SIZE || memcmp(header, HEADER_MAGIC, HEADER_MAGIC_SIZE) != 0)
+        return nullptr;
+    return header;
+}
+
+bool isStandalone(const MappedFile& file)
+{
+    return findHeader(file) != nullptr;
+}
+
 bool isStandalone(const char* file)
 {
-    char buffer[HEADER_MAGIC_SIZE]{};
+    try
+    {
+        return isStandalone(MappedFile(file));
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+}
 
-    std::ifstream ifs(file);
-    if (ifs.is_open())
+ByteRange standaloneZip(const MappedFile& file)
+{
+    const unsigned char* header = findHeader(file);
+    if (header)
     {
-        // skip the first line, it's the shebang
-        std::string shebang;
-        std::getline(ifs, shebang);
-        ifs.read(buffer, sizeof(buffer));
+        const size_t rest = file.data() + file.size() - header;
+        if (rest >= sizeof(StandaloneHeader))
+            return ByteRange{ header + sizeof(StandaloneHeader), rest - sizeof(StandaloneHeader) };
     }
-    return memcmp(buffer, HEADER_MAGIC, HEADER_MAGIC_SIZE) == 0;
+    return ByteRange{ nullptr, 0 };
 }
 
 static bytestring readFile(std::ifstream& ifs)
@@ -90,7 +176,9 @@ static RSA* readPrivateKey()
         throw std::runtime_error("Failed to open private key file!");
 
     RSA* privkey = RSA_new();
-    if (!PEM_read_RSAPrivateKey(pk, &privkey, nullptr, nullptr))
+    const bool ok = PEM_read_RSAPrivateKey(pk, &privkey, nullptr, nullptr) != nullptr;
+    fclose(pk);
+    if (!ok)
     {
         RSA_free(privkey);
         throw std::runtime_error("Invalid private key file!");
@@ -99,14 +187,60 @@ static RSA* readPrivateKey()
     return privkey;
 }
 
-bytestring sign(const bytestring& data)
+/// the signing key: read once (thread-safe), then shared by all threads, never freed
+static RSA* privateKey()
+{
+    static RSA* const privkey = readPrivateKey();
+    return privkey;
+}
+
+Digest digestStream(std::istream& is)
+{
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(),
+                                                                EVP_MD_CTX_free);
+    if (!ctx || EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr) != 1)
+        throw std::runtime_error("EVP_DigestInit_ex() failed");
+
+    std::vector<char> buffer(CHUNK_SIZE);
+    while (is.read(buffer.data(), buffer.size()) || is.gcount() > 0)
+    {
+        if (EVP_DigestUpdate(ctx.get(), buffer.data(), is.gcount()) != 1)
+            throw std::runtime_error("EVP_DigestUpdate() failed");
+    }
+    if (is.bad())
+        throw std::runtime_error("read error");
+
+    Digest digest;
+    unsigned int size = 0;
+    if (EVP_DigestFinal_ex(ctx.get(), digest.data(), &size) != 1 || size != digest.size())
+        throw std::runtime_error("EVP_DigestFinal_ex() failed");
+    return digest;
+}
+
+Digest digestFile(const char* file)
+{
+    std::ifstream ifs(file, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error(strerror(errno));
+
+    return digestStream(ifs);
+}
+
+Digest digestMemory(const void* data, size_t size)
 {
-    RSA* privkey = readPrivateKey();
+    Digest digest;
+    unsigned int digestSize = 0;
+    if (EVP_Digest(data, size, digest.data(), &digestSize, EVP_sha256(), nullptr) != 1 ||
+        digestSize != digest.size())
+        throw std::runtime_error("EVP_Digest() failed");
+    return digest;
+}
 
+bytestring sign(const Digest& digest)
+{
     unsigned char sigbuf[SIGNATURE_SIZE];
     unsigned int siglen = 0;
-    int rc = RSA_sign(NID_sha256, data.data(), data.size(), sigbuf, &siglen, privkey);
-    RSA_free(privkey);
+    int rc = RSA_sign(NID_sha256, digest.data(), digest.size(), sigbuf, &siglen, privateKey());
 
     if (rc != 1)
         throw std::runtime_error("RSA_sign() failed :-(");
@@ -122,15 +256,45 @@ void createDetachedSignature(const char* file)
     std::string signaturePath = file;
     signaturePath += ".signature";
 
-    const auto content = readFile(file);
-    const auto signature = sign(content);
+    writeFile(signaturePath.c_str(), sign(digestFile(file)));
+}
 
-    std::ofstream sigfile(signaturePath);
-    if (!sigfile.is_open())
-        throw std::runtime_error(strerror(errno));
+/// permissions of new files, like std::ofstream would create them
+static mode_t newFileMode()
+{
+    // the umask can only be read by setting it: only done once
+    static const mode_t mode = [] {
+        const mode_t mask = umask(0);
+        umask(mask);
+        return 0666 & ~mask;
+    }();
+    return mode;
+}
 
-    sigfile.write((const char*)signature.data(), signature.size());
-    sigfile.flush();
+void writeFile(const char* file, const bytestring& content)
+{
+    std::string tmpPath = std::string(file) + ".XXXXXX";
+    int fd = mkstemp(&tmpPath[0]);
+    if (fd < 0)
+        throw std::runtime_error(std::string(file) + ": " + strerror(errno));
+
+    size_t done = 0;
+    while (done < content.size())
+    {
+        const ssize_t n = write(fd, content.data() + done, content.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    const bool ok = done == content.size() && fchmod(fd, newFileMode()) == 0 && fsync(fd) == 0;
+    if (close(fd) != 0 || !ok || rename(tmpPath.c_str(), file) != 0)
+    {
+        const int err = errno;
+        unlink(tmpPath.c_str());
+        throw std::runtime_error(std::string(file) + ": " + strerror(err));
+    }
 }
 
 void makeStandalone(const char* zipFile, const char* outFile)
@@ -139,55 +303,82 @@ void makeStandalone(const char* zipFile, const char* outFile)
     StandaloneHeader header;
     memcpy(header.magic, HEADER_MAGIC, HEADER_MAGIC_SIZE);
 
-    auto zipContent = readFile(zipFile);
-    auto signature = sign(zipContent);
+    std::ifstream zip(zipFile, std::ios::binary);
+    if (!zip.is_open())
+        throw std::runtime_error(strerror(errno));
+
+    auto signature = sign(digestStream(zip));
     if (signature.size() != sizeof(header.signature))
         throw std::runtime_error("signature size mismatch");
     memcpy(header.signature, signature.data(), signature.size());
 
-    std::ofstream ofs(outFile);
+    std::ofstream ofs(outFile, std::ios::binary);
     if (!ofs.is_open())
         throw std::runtime_error(strerror(errno));
 
-    ofs << "#!/usr/bin/env mypy\n";
+    ofs << SHEBANG;
     ofs.write((const char*)&header, sizeof(header));
-    ofs.write((const char*)zipContent.data(), zipContent.size());
+
+    // second pass: copy the ZIP chunk by chunk
+    zip.clear();
+    zip.seekg(0);
+    std::vector<char> buffer(CHUNK_SIZE);
+    while (zip.read(buffer.data(), buffer.size()) || zip.gcount() > 0)
+        ofs.write(buffer.data(), zip.gcount());
     ofs.close();
+    if (zip.bad() || !ofs)
+        throw std::runtime_error("failed to write " + std::string(outFile));
 
     chmod(outFile, 0777);
 }
 
-static SignatureStatus verifySignature(const bytestring& sig, const bytestring& data)
+static RSA* readPublicKey()
+{
+    std::unique_ptr<BIO, decltype(&BIO_free)> bio(BIO_new_mem_buf(PUBLIC_KEY, -1), BIO_free);
+    if (!bio)
+        throw std::runtime_error("BIO_new_mem_buf() failed");
+
+    RSA* pubkey = PEM_read_bio_RSA_PUBKEY(bio.get(), nullptr, nullptr, nullptr);
+    if (!pubkey)
+        throw std::runtime_error("Invalid public key!");
+
+    return pubkey;
+}
+
+/// the verification key: parsed once (thread-safe), then only read, never freed
+static RSA* publicKey()
 {
-    RSA* privkey = readPrivateKey();
+    static RSA* const pubkey = readPublicKey();
+    return pubkey;
+}
 
-    int rc = RSA_verify(NID_sha256, data.data(), data.size(), sig.data(), sig.size(), privkey);
-    RSA_free(privkey);
+SignatureStatus verifySignature(const bytestring& sig, const Digest& digest)
+{
+    int rc = RSA_verify(NID_sha256, digest.data(), digest.size(), sig.data(), sig.size(),
+                        publicKey());
 
     if (rc == 1)
         return SignatureStatus::VALID;
     return SignatureStatus::INVALID;
 }
 
-SignatureStatus checkStandaloneSignature(const char* file)
+SignatureStatus checkStandaloneSignature(const MappedFile& file)
+{
+    return checkStandaloneSignature(file, verifySignature);
+}
+
+SignatureStatus checkStandaloneSignature(const MappedFile& file, const Verifier& verify)
 {
     try
     {
-        auto content = readFile(file);
-        // remove the first line
-        size_t pos = content.find('\n');
-        if (pos != std::string::npos)
-            content.erase(0, pos + 1);
-        if (content.size() >= sizeof(StandaloneHeader))
+        const ByteRange zip = standaloneZip(file);
+        if (zip.data)
         {
-            // separate the header
-            StandaloneHeader header;
-            memcpy(&header, content.data(), sizeof(header));
-            content.erase(0, sizeof(header));
-
-            // verify the rest
-            bytestring signature(header.signature, sizeof(header.signature));
-            return verifySignature(signature, content);
+            // the header is right in front of the ZIP
+            const StandaloneHeader* header =
+              reinterpret_cast<const StandaloneHeader*>(zip.data - sizeof(StandaloneHeader));
+            bytestring signature(header->signature, sizeof(header->signature));
+            return verify(signature, digestMemory(zip.data, zip.size));
         }
     }
     catch (std::exception&)
@@ -196,7 +387,24 @@ SignatureStatus checkStandaloneSignature(const char* file)
     return SignatureStatus::INVALID;
 }
 
+SignatureStatus checkStandaloneSignature(const char* file)
+{
+    try
+    {
+        return checkStandaloneSignature(MappedFile(file));
+    }
+    catch (std::exception&)
+    {
+        return SignatureStatus::INVALID;
+    }
+}
+
 SignatureStatus checkDetachedSignature(const char* file)
+{
+    return checkDetachedSignature(file, verifySignature);
+}
+
+SignatureStatus checkDetachedSignature(const char* file, const Verifier& verify)
 {
     std::string signaturePath = file;
     signaturePath += ".signature";
@@ -213,6 +421,12 @@ SignatureStatus checkDetachedSignature(const char* file)
     }
 
     auto signature = readFile(ifs);
-    auto content = readFile(file);
-    return verifySignature(signature, content);
+    try
+    {
+        return verify(signature, digestFile(file));
+    }
+    catch (std::exception&)
+    {
+        return SignatureStatus::INVALID;
+    }
 }
@@ -9,6 +9,10 @@
 
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <istream>
 #include <string>
 
 /**
@@ -34,17 +38,58 @@ enum class SignatureStatus
     UNSIGNED
 };
 
+/**
+ * Read-only memory mapping of a whole file: it's read from disk (at most) once, no matter how
+ * often the content is used.
+ * Note: the mapping is private, but it isn't a snapshot. Writes to the file (in place) become
+ * visible, and truncating it makes accessing the cut-off part fail with SIGBUS. Only replacing
+ * the file (rename/unlink) doesn't affect the mapping.
+ */
+class MappedFile
+{
+public:
+    /// @throws std::runtime_error if the file can't be opened or mapped
+    explicit MappedFile(const char* file);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+};
+
+/// part of a mapped file
+struct ByteRange
+{
+    const unsigned char* data;
+    size_t size;
+};
+
 /**
  * @param[in] file      script path
  * @return whether this is a standalone script
  */
 bool isStandalone(const char* file);
+/// @overload
+bool isStandalone(const MappedFile& file);
+/**
+ * Locates the ZIP of a standalone script (everything behind the header).
+ * @param[in] file      the mapped script
+ * @return the ZIP, or {nullptr, 0} if this isn't a standalone script
+ */
+ByteRange standaloneZip(const MappedFile& file);
 /**
  * Checks the signature of a standalone script.
  * @param[in] file      script path
  * @return valid/invalid ("unsigned" is not possible here)
  */
 SignatureStatus checkStandaloneSignature(const char* file);
+/// @overload
+SignatureStatus checkStandaloneSignature(const MappedFile& file);
 /**
  * Checks the detached signature of a script.
  * @param[in] file      script path
@@ -54,14 +99,55 @@ SignatureStatus checkDetachedSignature(const char* file);
 
 using bytestring = std::basic_string<unsigned char>;
 
+/// SHA-256 digest: what the signatures are computed over
+using Digest = std::array<unsigned char, 32>;
+
+/**
+ * Hashes a stream in fixed-size chunks, so memory use doesn't depend on the size.
+ * @param[in] is        the stream, read until its end
+ * @return the SHA-256 digest
+ */
+Digest digestStream(std::istream& is);
+/**
+ * @param[in] file      file path
+ * @return the SHA-256 digest of the file's content
+ */
+Digest digestFile(const char* file);
+/**
+ * @param[in] data      the data to hash
+ * @param[in] size      its size in bytes
+ * @return the SHA-256 digest
+ */
+Digest digestMemory(const void* data, size_t size);
+
 /**
- * Signs some data.
- * @param[in] data      the data to sign
+ * Signs a digest (RSA PKCS #1 v1.5 with SHA-256, like "openssl dgst -sha256 -sign").
+ * The private key is read on the first call. May be called by several threads at once.
+ * @param[in] digest    digest of the data to sign
  * @return the signature
  */
-bytestring sign(const bytestring& data);
+bytestring sign(const Digest& digest);
+/**
+ * Checks a signature with the embedded public key.
+ * @param[in] sig       the signature
+ * @param[in] digest    digest of the signed data
+ * @return valid/invalid
+ */
+SignatureStatus verifySignature(const bytestring& sig, const Digest& digest);
+/// checks a signature like verifySignature() - or e.g. looks up a cached result first
+using Verifier = std::function<SignatureStatus(const bytestring& sig, const Digest& digest)>;
+/// @overload checkStandaloneSignature(), with a custom check of the signature
+SignatureStatus checkStandaloneSignature(const MappedFile& file, const Verifier& verify);
+/// @overload checkDetachedSignature(), with a custom check of the signature
+SignatureStatus checkDetachedSignature(const char* file, const Verifier& verify);
 /**
  * @param[in] file  file path
  * @return the file's content
  */
 bytestring readFile(const char* file);
+/**
+ * Writes a file atomically: readers see either the old or the complete new content.
+ * @param[in] file      file path
+ * @param[in] content   the new content
+ */
+void writeFile(const char* file, const bytestring& content);
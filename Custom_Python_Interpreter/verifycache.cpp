@@ -0,0 +1,185 @@
+/**
+ * Verification cache implementation.
+ */
+
+#include "verifycache.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+/// name of the HMAC key file in the cache directory
+static const char* const KEY_FILE = "key";
+
+/// content of an entry file (written as is: the cache is only read on the same machine)
+struct VerifyCache::Entry
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    Digest digest;
+    /// HMAC of everything above
+    Digest mac;
+};
+
+/// creates @a directory (if needed) and checks that only the user has access to it
+static bool makePrivateDirectory(const std::string& directory)
+{
+    struct stat st;
+    if (lstat(directory.c_str(), &st) != 0)
+    {
+        if (errno != ENOENT || mkdir(directory.c_str(), 0700) != 0 ||
+            lstat(directory.c_str(), &st) != 0)
+            return false;
+    }
+    return S_ISDIR(st.st_mode) && st.st_uid == getuid() && (st.st_mode & 077) == 0;
+}
+
+/// reads a file of exactly @a size bytes (std::ifstream costs more than the rest of a lookup)
+static bool readExactly(const std::string& file, void* data, size_t size)
+{
+    const int fd = open(file.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    char extra;
+    const bool ok = read(fd, data, size) == (ssize_t)size && read(fd, &extra, 1) == 0;
+    close(fd);
+    return ok;
+}
+
+/// creates a random key file, unless another process was faster
+static void createKey(const std::string& path)
+{
+    unsigned char key[32];
+    if (RAND_bytes(key, sizeof(key)) != 1)
+        return;
+
+    // written completely before it appears under its name: link() doesn't replace a key
+    std::string tmpPath = path + ".XXXXXX";
+    const int fd = mkstemp(&tmpPath[0]);
+    if (fd < 0)
+        return;
+    const bool ok = write(fd, key, sizeof(key)) == sizeof(key) && fsync(fd) == 0;
+    if (close(fd) == 0 && ok)
+        link(tmpPath.c_str(), path.c_str());
+    unlink(tmpPath.c_str());
+}
+
+VerifyCache::VerifyCache(const std::string& directory) : m_directory(directory), m_enabled(false)
+{
+    try
+    {
+        if (!makePrivateDirectory(directory))
+            return;
+
+        const std::string keyPath = directory + '/' + KEY_FILE;
+        if (access(keyPath.c_str(), F_OK) != 0)
+            createKey(keyPath);
+        m_enabled = readExactly(keyPath, m_key.data(), m_key.size());
+    }
+    catch (std::exception&)
+    {
+        // no cache
+    }
+}
+
+std::string VerifyCache::defaultDirectory()
+{
+    return "/var/tmp/mypy-" + std::to_string(getuid());
+}
+
+bool VerifyCache::makeEntry(const char* file, const Digest& digest, Entry& entry) const
+{
+    static_assert(sizeof(Entry) == 5 * 8 + 2 * 32, "entries must not contain padding");
+
+    struct stat st;
+    if (!m_enabled || stat(file, &st) != 0)
+        return false;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.device = st.st_dev;
+    entry.inode = st.st_ino;
+    entry.size = st.st_size;
+    entry.mtimeSec = st.st_mtim.tv_sec;
+    entry.mtimeNsec = st.st_mtim.tv_nsec;
+    entry.digest = digest;
+    return true;
+}
+
+std::string VerifyCache::entryPath(const Entry& entry) const
+{
+    char name[48];
+    snprintf(name, sizeof(name), "/%llx-%llx", (unsigned long long)entry.device,
+             (unsigned long long)entry.inode);
+    return m_directory + name;
+}
+
+void VerifyCache::computeMac(const Entry& entry, Digest& mac) const
+{
+    // HMAC-SHA256 (RFC 2104) on top of digestMemory(): OpenSSL's HMAC() looks up its
+    // implementation first, which costs more than the RSA operation in a fresh process
+    constexpr size_t BLOCK_SIZE = 64;
+    unsigned char inner[BLOCK_SIZE + offsetof(Entry, mac)];
+    unsigned char outer[BLOCK_SIZE + sizeof(Digest)];
+    for (size_t i = 0; i < BLOCK_SIZE; ++i)
+    {
+        const unsigned char key = i < m_key.size() ? m_key[i] : 0;
+        inner[i] = key ^ 0x36;
+        outer[i] = key ^ 0x5c;
+    }
+    memcpy(inner + BLOCK_SIZE, &entry, offsetof(Entry, mac));
+    const Digest innerDigest = digestMemory(inner, sizeof(inner));
+    memcpy(outer + BLOCK_SIZE, innerDigest.data(), innerDigest.size());
+    mac = digestMemory(outer, sizeof(outer));
+}
+
+bool VerifyCache::contains(const char* file, const Digest& digest) const
+{
+    try
+    {
+        Entry expected;
+        if (!makeEntry(file, digest, expected))
+            return false;
+
+        Entry entry;
+        if (!readExactly(entryPath(expected), &entry, sizeof(Entry)))
+            return false;
+
+        // same file, unchanged, with the same content - and the entry hasn't been forged
+        computeMac(expected, expected.mac);
+        return memcmp(&entry, &expected, offsetof(Entry, mac)) == 0 &&
+               CRYPTO_memcmp(entry.mac.data(), expected.mac.data(), expected.mac.size()) == 0;
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+}
+
+void VerifyCache::insert(const char* file, const Digest& digest) const
+{
+    try
+    {
+        Entry entry;
+        if (!makeEntry(file, digest, entry))
+            return;
+        computeMac(entry, entry.mac);
+        writeFile(entryPath(entry).c_str(),
+                  bytestring(reinterpret_cast<const unsigned char*>(&entry), sizeof(Entry)));
+    }
+    catch (std::exception&)
+    {
+        // the next run just verifies again
+    }
+}
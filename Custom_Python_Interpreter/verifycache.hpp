@@ -0,0 +1,57 @@
+/**
+ * Persistent cache of signature checks, so unchanged scripts skip the public key operation.
+ */
+
+#pragma once
+
+#include "signatures.hpp" // for Digest
+
+#include <array>
+#include <string>
+
+/**
+ * Remembers the scripts with a valid signature across runs of the interpreter.
+ *
+ * There is one entry file per script, named after its device and inode. It holds the size and
+ * mtime of the script and the digest of the signed content, and an HMAC of all that. The HMAC key
+ * is created on first use and stored next to the entries. The digest is computed on every check
+ * anyway: an entry only vouches that this content has been signed, so a stale entry can't make
+ * modified content valid.
+ *
+ * Only the user may access the cache directory (else it isn't used), so others can neither read
+ * the key nor forge entries. Any process of the same user can, though (just like it could replace
+ * the scripts).
+ * The cache is only an optimization: all its errors are ignored, it's just not used then.
+ */
+class VerifyCache
+{
+public:
+    /// @param[in] directory    cache directory, created (mode 0700) if needed
+    explicit VerifyCache(const std::string& directory);
+    /// /var/tmp/mypy-UID (not below $HOME: the environment is ignored, and getpwuid() is slow)
+    static std::string defaultDirectory();
+
+    /**
+     * @param[in] file      script path
+     * @param[in] digest    digest of its signed content
+     * @return whether a valid signature has been recorded for it
+     */
+    bool contains(const char* file, const Digest& digest) const;
+    /**
+     * Records a valid signature.
+     * @param[in] file      script path
+     * @param[in] digest    digest of its signed content
+     */
+    void insert(const char* file, const Digest& digest) const;
+
+private:
+    struct Entry;
+    /// fills in everything but the HMAC
+    bool makeEntry(const char* file, const Digest& digest, Entry& entry) const;
+    std::string entryPath(const Entry& entry) const;
+    void computeMac(const Entry& entry, Digest& mac) const;
+
+    std::string m_directory;
+    std::array<unsigned char, 32> m_key;
+    bool m_enabled;
+};
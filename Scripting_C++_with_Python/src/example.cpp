@@ -21,9 +21,13 @@
 #include <QtWidgets/QStyle>
 
 #include "captured_stream.hpp"
+#include "small_function.hpp"
 
 namespace py = pybind11;
 
+// button callbacks are called on every click -> no heap allocation for small callables
+using ButtonCallback = SmallFunction<void(int)>;
+
 
 /**
  * Encapulates access to the Python interpreter.
@@ -227,7 +231,7 @@ public:
     }
 
 
-    void addButtonCallback(std::function<void(int)> cb)
+    void addButtonCallback(ButtonCallback cb)
     {
         mButtonCallbacks.emplace_back(std::move(cb));
     }
@@ -258,7 +262,8 @@ private:
 
             // create a internal module that provides access to some functions
             py::module m("example", "My example module with pybind11");
-            m.def("addCallback", [this](std::function<void(int)> cb) { addButtonCallback(cb); });
+            m.def("addCallback",
+                  [this](std::function<void(int)> cb) { addButtonCallback(std::move(cb)); });
             m.def("clearCallbacks", [this]() { clearCallbacks(); });
             m.def("setIconState",
                   [this](int num, bool on) -> bool { return setIconState(num, on); },
@@ -298,7 +303,7 @@ private:
 
     std::unique_ptr<PythonInterpreter> mInterpreter;
 
-    std::vector<std::function<void(int)>> mButtonCallbacks;
+    std::vector<ButtonCallback> mButtonCallbacks;
 };
 
 int main(int argc, char** argv)
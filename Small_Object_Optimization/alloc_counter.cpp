@@ -0,0 +1,54 @@
+/**
+ * @file    alloc_counter.cpp
+ * @brief   replacement of the global operator new/delete that counts allocations
+ *
+ * This lives in its own translation unit so the compiler can't "see" new and free() meeting.
+ */
+
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::size_t> g_allocations{ 0 };
+static std::atomic<std::size_t> g_deallocations{ 0 };
+
+std::size_t allocationCount() noexcept
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
+std::size_t deallocationCount() noexcept
+{
+    return g_deallocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+void operator delete(void* ptr) noexcept
+{
+    if (ptr)
+        g_deallocations.fetch_add(1, std::memory_order_relaxed);
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    ::operator delete(ptr);
+}
@@ -0,0 +1,14 @@
+/**
+ * @file    alloc_counter.hpp
+ * @brief   global allocation counters, fed by the operator new replacement in alloc_counter.cpp
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/// number of calls to the global operator new since program start
+std::size_t allocationCount() noexcept;
+
+/// number of calls to the global operator delete (with a non-null pointer) since program start
+std::size_t deallocationCount() noexcept;
@@ -0,0 +1,110 @@
+/**
+ * @file    batch_dispatch.hpp
+ * @brief   visit many SmallPtrs grouped by type, so each group is a loop without virtual calls
+ *
+ * Calling a virtual function on a collection of mixed types jumps to a different target for
+ * almost every element, which the branch predictor can't handle well. The BatchDispatcher sorts
+ * the elements into one group per storage function (= per type, see SmallPtr::dispatch()) and
+ * calls the visitor with the real type, so the compiler can devirtualize (and inline) the calls.
+ */
+
+#pragma once
+
+#include "v6_function_ptr.hpp"
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Groups SmallPtr<T, ...> elements by type. @a Derived are the types that get their own group
+ * and are passed to the visitor with their real type, all other objects are passed as T&.
+ *
+ * The groups are kept until the next call of assign(), so a collection that doesn't change can
+ * be visited multiple times without grouping it again.
+ */
+template <class Ptr, class... Derived>
+class BatchDispatcher
+{
+    static_assert(sizeof...(Derived) > 0, "need at least one type to group by");
+    using T = std::remove_pointer_t<decltype(std::declval<Ptr&>().get())>;
+
+public:
+    static constexpr std::size_t numGroups = sizeof...(Derived) + 1;
+
+    BatchDispatcher() = default;
+
+    template <class Range>
+    explicit BatchDispatcher(Range& range)
+    {
+        assign(range);
+    }
+
+    /// sorts all (non-empty) elements of @a range into the groups
+    template <class Range>
+    void assign(Range& range)
+    {
+        for (auto& group : m_groups)
+            group.clear();
+
+        for (Ptr& ptr : range)
+        {
+            if (ptr)
+                m_groups[groupOf(ptr.dispatch())].push_back(ptr.get());
+        }
+    }
+
+    /// number of elements in the group of type @a index (numGroups - 1 == "all other types")
+    std::size_t groupSize(std::size_t index) const noexcept { return m_groups[index].size(); }
+
+    /**
+     * Calls @a visitor for each element, group by group. Within a group, the order of the range
+     * is kept.
+     */
+    template <class Visitor>
+    void visit(Visitor&& visitor) const
+    {
+        visitGroups(visitor, std::index_sequence_for<Derived...>{});
+        for (T* ptr : m_groups.back())
+            visitor(*ptr);
+    }
+
+private:
+    using StorageFunc = decltype(std::declval<const Ptr&>().dispatch());
+
+    static std::size_t groupOf(StorageFunc func) noexcept
+    {
+        static constexpr StorageFunc funcs[] = { Ptr::template dispatchFor<Derived>()... };
+        for (std::size_t i = 0; i < sizeof...(Derived); ++i)
+        {
+            if (funcs[i] == func)
+                return i;
+        }
+        return numGroups - 1;
+    }
+
+    template <class Visitor, std::size_t... I>
+    void visitGroups(Visitor& visitor, std::index_sequence<I...>) const
+    {
+        (visitGroup<Derived>(visitor, m_groups[I]), ...);
+    }
+
+    template <class Type, class Visitor>
+    static void visitGroup(Visitor& visitor, const std::vector<T*>& group)
+    {
+        for (T* ptr : group)
+            visitor(static_cast<Type&>(*ptr));
+    }
+
+    std::array<std::vector<T*>, numGroups> m_groups;
+};
+
+/// convenience function: group @a range and visit it once
+template <class... Derived, class T, size_t N, class Alloc, size_t A, class Visitor>
+void batchVisit(std::vector<SmallPtr<T, N, Alloc, A>>& range, Visitor&& visitor)
+{
+    BatchDispatcher<SmallPtr<T, N, Alloc, A>, Derived...> dispatcher(range);
+    dispatcher.visit(std::forward<Visitor>(visitor));
+}
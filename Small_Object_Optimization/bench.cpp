@@ -0,0 +1,859 @@
+/**
+ * @file    bench.cpp
+ * @brief   benchmarks comparing all SmallPtr versions on the same workloads
+ *
+ * Every version defines its own SmallPtr in the global namespace, so each header is pulled into
+ * a namespace of its own. All standard headers they need must be included before that.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "alloc_counter.hpp"
+#include "pets.hpp"
+
+namespace v1 {
+#include "v1_unique_ptr.hpp"
+}
+namespace v2 {
+#include "v2_with_stubs.hpp"
+}
+namespace v3 {
+#include "v3_type_erased.hpp"
+}
+namespace v4 {
+#include "v4_small_opt1.hpp"
+}
+namespace v5 {
+#include "v5_small_opt2.hpp"
+}
+namespace v6 {
+#include "v6_function_ptr.hpp"
+
+#include "batch_dispatch.hpp"
+#include "mpsc_queue.hpp"
+#include "poly_vector.hpp"
+#include "slab_allocator.hpp"
+#include "small_function.hpp"
+#include "small_shared_ptr.hpp"
+#include "small_value.hpp"
+}
+namespace v7 {
+#include "v7_inline_vtable.hpp"
+}
+
+
+/// counts the allocations between construction and report()
+class AllocationCounter
+{
+public:
+    AllocationCounter() : m_start(allocationCount()) {}
+
+    /// adds "allocs/op" and "sizeof" to the benchmark output
+    template <class Ptr>
+    void report(benchmark::State& state, std::size_t opsPerIteration = 1) const
+    {
+        const auto allocations = allocationCount() - m_start;
+        state.counters["allocs/op"] =
+          benchmark::Counter(static_cast<double>(allocations) /
+                               static_cast<double>(opsPerIteration),
+                             benchmark::Counter::kAvgIterations);
+        state.counters["sizeof"] = static_cast<double>(sizeof(Ptr));
+        state.SetItemsProcessed(state.iterations() *
+                                static_cast<benchmark::IterationCount>(opsPerIteration));
+    }
+
+private:
+    std::size_t m_start;
+};
+
+
+//
+// uniform construction of pets (v1 has no emplace())
+//
+
+template <class Derived, class T, class... Args>
+void emplace(v1::SmallPtr<T>& ptr, Args&&... args)
+{
+    ptr.reset(new Derived(std::forward<Args>(args)...));
+}
+template <class Derived, class T, class... Args>
+void emplace(std::unique_ptr<T>& ptr, Args&&... args)
+{
+    ptr.reset(new Derived(std::forward<Args>(args)...));
+}
+template <class Derived, class T, class... Args>
+void emplace(std::shared_ptr<T>& ptr, Args&&... args)
+{
+    ptr = std::make_shared<Derived>(std::forward<Args>(args)...);
+}
+template <class Derived, class T, class... Args>
+void emplace(v6::PolyVector<T>& vec, Args&&... args)
+{
+    vec.template emplace_back<Derived>(std::forward<Args>(args)...);
+}
+template <class Derived, class Ptr, class... Args>
+void emplace(Ptr& ptr, Args&&... args)
+{
+    ptr.template emplace<Derived>(std::forward<Args>(args)...);
+}
+
+/// knows how to create each pet with some representative arguments
+template <class Pet>
+struct PetFactory;
+
+template <>
+struct PetFactory<Cat>
+{
+    template <class Ptr>
+    static void create(Ptr& ptr)
+    {
+        emplace<Cat>(ptr);
+    }
+};
+template <>
+struct PetFactory<Dog>
+{
+    template <class Ptr>
+    static void create(Ptr& ptr)
+    {
+        emplace<Dog>(ptr, "Bob");
+    }
+};
+template <>
+struct PetFactory<Parrot>
+{
+    template <class Ptr>
+    static void create(Ptr& ptr)
+    {
+        emplace<Parrot>(ptr, "Polly");
+    }
+};
+template <>
+struct PetFactory<Elephant>
+{
+    template <class Ptr>
+    static void create(Ptr& ptr)
+    {
+        emplace<Elephant>(ptr, 300, 4500.0);
+    }
+};
+
+
+//
+// workloads
+//
+
+/// construct a pet and destroy it again
+template <class Ptr, class Pet>
+static void BM_ConstructDestroy(benchmark::State& state)
+{
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        Ptr ptr;
+        PetFactory<Pet>::create(ptr);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+/// move a pet back and forth between two pointers (2 moves per iteration)
+template <class Ptr, class Pet>
+static void BM_Move(benchmark::State& state)
+{
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        Ptr other(std::move(ptr));
+        ptr = std::move(other);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state, 2);
+}
+
+/// swap two pets (custom swap() if there is one, else std::swap)
+template <class Ptr, class Pet>
+static void BM_Swap(benchmark::State& state)
+{
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+    Ptr other;
+    PetFactory<Cat>::create(other);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        using std::swap;
+        swap(ptr, other);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+/// copy a shared pet and release the copy again
+template <class Ptr, class Pet>
+static void BM_SharedCopy(benchmark::State& state)
+{
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        Ptr copy(ptr);
+        benchmark::DoNotOptimize(copy.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+/// access the pet through operator->
+template <class Ptr, class Pet>
+static void BM_Access(benchmark::State& state)
+{
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        // don't let the compiler hoist the lookup out of the loop
+        benchmark::DoNotOptimize(ptr);
+        IPet* pet = ptr.operator->();
+        benchmark::DoNotOptimize(pet);
+    }
+    counter.report<Ptr>(state);
+}
+
+/// replace the pet in an existing pointer
+template <class Ptr, class Pet>
+static void BM_EmplaceChurn(benchmark::State& state)
+{
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        PetFactory<Pet>::create(ptr);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+
+/// makes PetFactory call emplaceStrong()
+class StrongPtr : public v6::SmallPtr<IPet>
+{
+public:
+    template <class Derived, class... Args>
+    void emplace(Args&&... args)
+    {
+        emplaceStrong<Derived>(std::forward<Args>(args)...);
+    }
+};
+
+/// emplace() churn with emplaceStrong() instead of emplace()
+template <class Pet>
+static void BM_EmplaceStrongChurn(benchmark::State& state)
+{
+    using Ptr = v6::SmallPtr<IPet>;
+    StrongPtr ptr;
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        PetFactory<Pet>::create(ptr);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+
+/// emplace() churn with a pool resource serving the heap fallback
+template <class Pet>
+static void BM_EmplaceChurnPool(benchmark::State& state)
+{
+    using Ptr = v6::SmallPtr<IPet, 64, std::pmr::polymorphic_allocator<IPet>>;
+    std::pmr::unsynchronized_pool_resource pool;
+    Ptr ptr(&pool);
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        PetFactory<Pet>::create(ptr);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+/// emplace() churn with SlabAllocator serving the heap fallback
+template <class Pet>
+static void BM_EmplaceChurnSlab(benchmark::State& state)
+{
+    using Ptr = v6::SmallPtr<IPet, 64, v6::SlabAllocator<IPet>>;
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        PetFactory<Pet>::create(ptr);
+        benchmark::DoNotOptimize(ptr.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+/// create a burst of pets, then destroy all of them
+template <class Ptr, class Pet>
+static void BM_EmplaceBurst(benchmark::State& state)
+{
+    std::vector<Ptr> pets(static_cast<std::size_t>(state.range(0)));
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        for (Ptr& pet : pets)
+            PetFactory<Pet>::create(pet);
+        benchmark::DoNotOptimize(pets.data());
+        for (Ptr& pet : pets)
+            pet.reset();
+    }
+    counter.report<Ptr>(state, pets.size());
+}
+
+
+/// copy a pet held by SmallValue
+template <class Pet>
+static void BM_CopySmallValue(benchmark::State& state)
+{
+    using Value = v6::SmallValue<IPet>;
+    Value value;
+    PetFactory<Pet>::create(value);
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        Value copy(value);
+        benchmark::DoNotOptimize(copy.get());
+    }
+    counter.report<Value>(state);
+}
+
+/// the alternative: a clone() function returning a unique_ptr
+template <class Pet>
+static void BM_CopyClone(benchmark::State& state)
+{
+    using Ptr = std::unique_ptr<IPet>;
+    Ptr ptr;
+    PetFactory<Pet>::create(ptr);
+    // what a typical "virtual std::unique_ptr<IPet> clone() const" would do
+    auto clone = [](const IPet& pet) -> Ptr { return Ptr(new Pet(static_cast<const Pet&>(pet))); };
+
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        Ptr copy = clone(*ptr);
+        benchmark::DoNotOptimize(copy.get());
+    }
+    counter.report<Ptr>(state);
+}
+
+/// fill a vector without reserving, so it has to move its elements repeatedly
+template <class Pet>
+static void BM_VectorGrow(benchmark::State& state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    for (auto _ : state)
+    {
+        std::vector<v6::SmallPtr<IPet>> pets;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            pets.emplace_back();
+            PetFactory<Pet>::create(pets.back());
+        }
+        benchmark::DoNotOptimize(pets.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+//
+// iterating over many mixed pets
+//
+
+static constexpr std::size_t g_numPets = 1 << 20;
+
+template <class Pet>
+struct PetTag
+{
+    using type = Pet;
+};
+
+/// every 16th pet is a (large) parrot, the rest are cats and dogs
+template <class Create>
+static void fillMixed(Create create)
+{
+    for (std::size_t i = 0; i < g_numPets; ++i)
+    {
+        if (i % 16 == 15)
+            create(PetTag<Parrot>{});
+        else if (i % 2)
+            create(PetTag<Dog>{});
+        else
+            create(PetTag<Cat>{});
+    }
+}
+
+template <class Container>
+static void makeNoise(benchmark::State& state, Container& pets)
+{
+    for (auto _ : state)
+    {
+        std::size_t total = 0;
+        for (IPet& pet : pets)
+            total += pet.makeSomeNoise().size();
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(g_numPets));
+}
+
+/// helper to iterate over a vector of pointers as if it contained the pets
+template <class Ptr>
+struct DerefVector
+{
+    std::vector<Ptr> ptrs;
+
+    struct Iterator
+    {
+        typename std::vector<Ptr>::iterator it;
+        IPet& operator*() const { return **it; }
+        Iterator& operator++()
+        {
+            ++it;
+            return *this;
+        }
+        bool operator!=(const Iterator& rhs) const { return it != rhs.it; }
+    };
+    Iterator begin() { return Iterator{ ptrs.begin() }; }
+    Iterator end() { return Iterator{ ptrs.end() }; }
+};
+
+static void BM_NoiseUniquePtrVector(benchmark::State& state)
+{
+    DerefVector<std::unique_ptr<IPet>> pets;
+    fillMixed([&](auto tag) {
+        pets.ptrs.emplace_back();
+        PetFactory<typename decltype(tag)::type>::create(pets.ptrs.back());
+    });
+    makeNoise(state, pets);
+}
+static void BM_NoiseSmallPtrVector(benchmark::State& state)
+{
+    DerefVector<v6::SmallPtr<IPet>> pets;
+    fillMixed([&](auto tag) {
+        pets.ptrs.emplace_back();
+        PetFactory<typename decltype(tag)::type>::create(pets.ptrs.back());
+    });
+    makeNoise(state, pets);
+}
+static void BM_NoisePolyVector(benchmark::State& state)
+{
+    v6::PolyVector<IPet> pets;
+    fillMixed([&](auto tag) { PetFactory<typename decltype(tag)::type>::create(pets); });
+    makeNoise(state, pets);
+}
+
+//
+// grouping by type vs. virtual calls in random order
+//
+
+/// cats, dogs and parrots in random order
+static std::vector<v6::SmallPtr<IPet>> shuffledPets()
+{
+    std::vector<v6::SmallPtr<IPet>> pets(g_numPets);
+    fillMixed([&, i = std::size_t(0)](auto tag) mutable {
+        PetFactory<typename decltype(tag)::type>::create(pets[i++]);
+    });
+    std::shuffle(pets.begin(), pets.end(), std::mt19937(42));
+    return pets;
+}
+
+static void BM_NoiseVirtual(benchmark::State& state)
+{
+    auto pets = shuffledPets();
+    for (auto _ : state)
+    {
+        std::size_t total = 0;
+        for (auto& pet : pets)
+            total += pet->makeSomeNoise().size();
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(g_numPets));
+}
+
+/// groups once, visits many times
+static void BM_NoiseBatchPreGrouped(benchmark::State& state)
+{
+    auto pets = shuffledPets();
+    v6::BatchDispatcher<v6::SmallPtr<IPet>, Cat, Dog, Parrot> dispatcher(pets);
+    for (auto _ : state)
+    {
+        std::size_t total = 0;
+        dispatcher.visit([&](auto& pet) { total += pet.makeSomeNoise().size(); });
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(g_numPets));
+}
+
+/// groups on every visit
+static void BM_NoiseBatch(benchmark::State& state)
+{
+    auto pets = shuffledPets();
+    for (auto _ : state)
+    {
+        std::size_t total = 0;
+        v6::batchVisit<Cat, Dog, Parrot>(pets,
+                                         [&](auto& pet) { total += pet.makeSomeNoise().size(); });
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(g_numPets));
+}
+
+//
+// sorting and rotating large vectors (many moves and swaps)
+//
+
+template <class Ptr>
+static std::vector<Ptr> mixedPets()
+{
+    std::vector<Ptr> pets(g_numPets);
+    fillMixed([&, i = std::size_t(0)](auto tag) mutable {
+        PetFactory<typename decltype(tag)::type>::create(pets[i++]);
+    });
+    return pets;
+}
+
+/// sorts the pets by random keys
+template <class Ptr>
+static void BM_Sort(benchmark::State& state)
+{
+    std::vector<std::pair<std::uint32_t, Ptr>> pets;
+    pets.reserve(g_numPets);
+    for (Ptr& pet : mixedPets<Ptr>())
+        pets.emplace_back(0, std::move(pet));
+
+    std::mt19937 random(42);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (auto& pet : pets)
+            pet.first = static_cast<std::uint32_t>(random());
+        state.ResumeTiming();
+
+        std::sort(pets.begin(), pets.end(),
+                  [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(g_numPets));
+}
+
+/// std::rotate() only swaps
+template <class Ptr>
+static void BM_Rotate(benchmark::State& state)
+{
+    auto pets = mixedPets<Ptr>();
+    for (auto _ : state)
+    {
+        std::rotate(pets.begin(), pets.begin() + g_numPets / 3, pets.end());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(g_numPets));
+}
+
+//
+// passing messages from several producers to one consumer
+//
+
+static constexpr std::size_t g_numMessages = 1u << 16;
+
+/// adapter for PetFactory: emplace() spins until there's space in the lock-free queue
+class MpscProducer
+{
+public:
+    explicit MpscProducer(v6::MpscQueue<IPet, 1024>& queue) : m_queue(queue) {}
+
+    template <class Derived, class... Args>
+    void emplace(Args&&... args)
+    {
+        while (!m_queue.tryEmplace<Derived>(args...))
+            std::this_thread::yield();
+    }
+
+private:
+    v6::MpscQueue<IPet, 1024>& m_queue;
+};
+
+/// the same with a mutex, a std::deque and a heap allocation per message
+class MutexQueue
+{
+public:
+    using Ptr = std::unique_ptr<IPet>;
+
+    template <class Derived, class... Args>
+    void emplace(Args&&... args)
+    {
+        auto pet = std::make_unique<Derived>(std::forward<Args>(args)...);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(pet));
+    }
+
+    template <class Handler>
+    bool tryConsume(Handler&& handler)
+    {
+        std::unique_ptr<IPet> pet;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.empty())
+                return false;
+            pet = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        handler(*pet);
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<std::unique_ptr<IPet>> m_queue;
+};
+
+/// state.range(0) producers send g_numMessages pets in total, the calling thread consumes them
+template <class Pet, class Queue, class Producer>
+static void runQueue(benchmark::State& state, Queue& queue, Producer& producer)
+{
+    const auto numProducers = static_cast<std::size_t>(state.range(0));
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < numProducers; ++i)
+        {
+            threads.emplace_back([&] {
+                for (std::size_t n = 0; n < g_numMessages / numProducers; ++n)
+                    PetFactory<Pet>::create(producer);
+            });
+        }
+
+        std::size_t received = 0;
+        std::size_t total = 0;
+        while (received < g_numMessages / numProducers * numProducers)
+        {
+            if (queue.tryConsume([&](IPet& pet) { total += pet.makeSomeNoise().size(); }))
+                ++received;
+            else
+                std::this_thread::yield();
+        }
+        for (auto& thread : threads)
+            thread.join();
+        benchmark::DoNotOptimize(total);
+    }
+    counter.report<typename Queue::Ptr>(state, g_numMessages);
+}
+
+template <class Pet>
+static void BM_QueueMpsc(benchmark::State& state)
+{
+    v6::MpscQueue<IPet, 1024> queue;
+    MpscProducer producer(queue);
+    runQueue<Pet>(state, queue, producer);
+}
+
+template <class Pet>
+static void BM_QueueMutex(benchmark::State& state)
+{
+    MutexQueue queue;
+    runQueue<Pet>(state, queue, queue);
+}
+
+//
+// SmallFunction vs. std::function
+//
+
+/// a callable with a capture of (at least) T_CaptureSize bytes
+template <std::size_t T_CaptureSize>
+static auto makeCallback(std::size_t seed)
+{
+    std::array<std::size_t, T_CaptureSize / sizeof(std::size_t)> capture{};
+    capture.front() = seed;
+    return [capture](int value) { return capture.front() + static_cast<std::size_t>(value); };
+}
+
+template <class Func, std::size_t T_CaptureSize>
+static void BM_FunctionConstruct(benchmark::State& state)
+{
+    AllocationCounter counter;
+    std::size_t seed = 0;
+    for (auto _ : state)
+    {
+        Func func(makeCallback<T_CaptureSize>(seed++));
+        benchmark::DoNotOptimize(func);
+    }
+    counter.report<Func>(state);
+}
+
+/// invokes a list of callbacks, like a button handler
+template <class Func, std::size_t T_CaptureSize>
+static void BM_FunctionInvoke(benchmark::State& state)
+{
+    std::vector<Func> callbacks;
+    for (std::size_t i = 0; i < 1024; ++i)
+        callbacks.emplace_back(makeCallback<T_CaptureSize>(i));
+
+    for (auto _ : state)
+    {
+        std::size_t total = 0;
+        for (auto& cb : callbacks)
+            total += cb(1);
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<benchmark::IterationCount>(callbacks.size()));
+}
+
+#define SMALLPTR_BENCHMARKS(Ptr, Pet)                                                              \
+    BENCHMARK_TEMPLATE(BM_ConstructDestroy, Ptr, Pet);                                             \
+    BENCHMARK_TEMPLATE(BM_Move, Ptr, Pet);                                                         \
+    BENCHMARK_TEMPLATE(BM_Swap, Ptr, Pet);                                                         \
+    BENCHMARK_TEMPLATE(BM_Access, Ptr, Pet);                                                       \
+    BENCHMARK_TEMPLATE(BM_EmplaceChurn, Ptr, Pet)
+
+#define SMALLPTR_BENCHMARKS_ALL_PETS(Ptr)                                                          \
+    SMALLPTR_BENCHMARKS(Ptr, Cat);                                                                 \
+    SMALLPTR_BENCHMARKS(Ptr, Dog);                                                                 \
+    SMALLPTR_BENCHMARKS(Ptr, Parrot)
+
+SMALLPTR_BENCHMARKS_ALL_PETS(v1::SmallPtr<IPet>);
+SMALLPTR_BENCHMARKS_ALL_PETS(v2::SmallPtr<IPet>);
+SMALLPTR_BENCHMARKS_ALL_PETS(v3::SmallPtr<IPet>);
+SMALLPTR_BENCHMARKS_ALL_PETS(v4::SmallPtr<IPet>);
+SMALLPTR_BENCHMARKS_ALL_PETS(v5::SmallPtr<IPet>);
+SMALLPTR_BENCHMARKS_ALL_PETS(v6::SmallPtr<IPet>);
+SMALLPTR_BENCHMARKS_ALL_PETS(v7::SmallPtr<IPet>);
+
+// v4 and v5 can't handle non-movable types (see TEST_MOVING in test.cpp)
+SMALLPTR_BENCHMARKS(v1::SmallPtr<IPet>, Elephant);
+SMALLPTR_BENCHMARKS(v2::SmallPtr<IPet>, Elephant);
+SMALLPTR_BENCHMARKS(v3::SmallPtr<IPet>, Elephant);
+SMALLPTR_BENCHMARKS(v6::SmallPtr<IPet>, Elephant);
+SMALLPTR_BENCHMARKS(v7::SmallPtr<IPet>, Elephant);
+
+BENCHMARK_TEMPLATE(BM_CopySmallValue, Cat);
+BENCHMARK_TEMPLATE(BM_CopySmallValue, Dog);
+BENCHMARK_TEMPLATE(BM_CopySmallValue, Parrot);
+BENCHMARK_TEMPLATE(BM_CopyClone, Cat);
+BENCHMARK_TEMPLATE(BM_CopyClone, Dog);
+BENCHMARK_TEMPLATE(BM_CopyClone, Parrot);
+
+// Cat is trivially relocatable, Dog isn't
+BENCHMARK_TEMPLATE(BM_VectorGrow, Cat)->Arg(10000);
+BENCHMARK_TEMPLATE(BM_VectorGrow, Dog)->Arg(10000);
+
+// compare with BM_EmplaceChurn<v6::SmallPtr<IPet>, ...>
+BENCHMARK_TEMPLATE(BM_EmplaceStrongChurn, Cat);
+BENCHMARK_TEMPLATE(BM_EmplaceStrongChurn, Dog);
+BENCHMARK_TEMPLATE(BM_EmplaceStrongChurn, Parrot);
+BENCHMARK_TEMPLATE(BM_EmplaceStrongChurn, Elephant);
+
+BENCHMARK_TEMPLATE(BM_EmplaceChurnPool, Parrot);
+BENCHMARK_TEMPLATE(BM_EmplaceChurnPool, Elephant);
+BENCHMARK_TEMPLATE(BM_EmplaceChurnSlab, Parrot);
+BENCHMARK_TEMPLATE(BM_EmplaceChurnSlab, Elephant);
+
+using SlabPet = v6::SmallPtr<IPet, 64, v6::SlabAllocator<IPet>>;
+BENCHMARK_TEMPLATE(BM_EmplaceBurst, v6::SmallPtr<IPet>, Parrot)->Arg(256);
+BENCHMARK_TEMPLATE(BM_EmplaceBurst, SlabPet, Parrot)->Arg(256);
+BENCHMARK_TEMPLATE(BM_EmplaceBurst, v6::SmallPtr<IPet>, Elephant)->Arg(256);
+BENCHMARK_TEMPLATE(BM_EmplaceBurst, SlabPet, Elephant)->Arg(256);
+
+BENCHMARK(BM_NoiseUniquePtrVector);
+BENCHMARK(BM_NoiseSmallPtrVector);
+BENCHMARK(BM_NoisePolyVector);
+
+BENCHMARK(BM_NoiseVirtual);
+BENCHMARK(BM_NoiseBatchPreGrouped);
+BENCHMARK(BM_NoiseBatch);
+
+// std::make_shared vs. pooled blocks
+#define SHARED_BENCHMARKS(Ptr, Pet)                                                                \
+    BENCHMARK_TEMPLATE(BM_ConstructDestroy, Ptr, Pet);                                             \
+    BENCHMARK_TEMPLATE(BM_SharedCopy, Ptr, Pet);                                                   \
+    BENCHMARK_TEMPLATE(BM_Access, Ptr, Pet)
+
+SHARED_BENCHMARKS(std::shared_ptr<IPet>, Cat);
+SHARED_BENCHMARKS(std::shared_ptr<IPet>, Dog);
+SHARED_BENCHMARKS(v6::SmallSharedPtr<IPet>, Cat);
+SHARED_BENCHMARKS(v6::SmallSharedPtr<IPet>, Dog);
+using UnsyncSharedPet = v6::SmallSharedPtr<IPet, 48, false>;
+SHARED_BENCHMARKS(UnsyncSharedPet, Cat);
+SHARED_BENCHMARKS(UnsyncSharedPet, Dog);
+
+// v7 has no swap() -> std::swap
+BENCHMARK_TEMPLATE(BM_Sort, std::unique_ptr<IPet>);
+BENCHMARK_TEMPLATE(BM_Sort, v1::SmallPtr<IPet>);
+BENCHMARK_TEMPLATE(BM_Sort, v6::SmallPtr<IPet>);
+BENCHMARK_TEMPLATE(BM_Sort, v7::SmallPtr<IPet>);
+BENCHMARK_TEMPLATE(BM_Rotate, std::unique_ptr<IPet>);
+BENCHMARK_TEMPLATE(BM_Rotate, v1::SmallPtr<IPet>);
+BENCHMARK_TEMPLATE(BM_Rotate, v6::SmallPtr<IPet>);
+BENCHMARK_TEMPLATE(BM_Rotate, v7::SmallPtr<IPet>);
+
+// std::function stores up to 16 bytes inline (libstdc++)
+#define FUNCTION_BENCHMARKS(CaptureSize)                                                           \
+    BENCHMARK_TEMPLATE(BM_FunctionConstruct, std::function<std::size_t(int)>, CaptureSize);        \
+    BENCHMARK_TEMPLATE(BM_FunctionConstruct, v6::SmallFunction<std::size_t(int)>, CaptureSize);    \
+    BENCHMARK_TEMPLATE(BM_FunctionInvoke, std::function<std::size_t(int)>, CaptureSize);           \
+    BENCHMARK_TEMPLATE(BM_FunctionInvoke, v6::SmallFunction<std::size_t(int)>, CaptureSize)
+
+FUNCTION_BENCHMARKS(8);
+FUNCTION_BENCHMARKS(32);
+FUNCTION_BENCHMARKS(64);
+
+BENCHMARK_TEMPLATE(BM_QueueMpsc, Cat)->Arg(1)->Arg(4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_QueueMpsc, Parrot)->Arg(1)->Arg(4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_QueueMutex, Cat)->Arg(1)->Arg(4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_QueueMutex, Parrot)->Arg(1)->Arg(4)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,632 @@
+/**
+ * @file    differential.cpp
+ * @brief   differential test: the same random operations on all SmallPtr versions side by side
+ *
+ * A byte string is decoded into a sequence of operations (emplace, move, reset, get, swap) on a
+ * few slots. Every version runs the sequence on slots of its own, and after each step it has to
+ * agree with a simple model on what each slot holds, how many pets are alive and how many
+ * allocations are outstanding. Like in bench.cpp, each version is pulled into its own namespace.
+ *
+ * Normally this is a gtest executable that runs a fixed set of random sequences. Compiled with
+ * SMALLPTR_LIBFUZZER (see ENABLE_LIBFUZZER in CMakeLists.txt), it's a libFuzzer target instead:
+ *   cmake -DENABLE_LIBFUZZER=ON -DCMAKE_CXX_COMPILER=clang++ -B build-fuzz && ./build-fuzz/fuzz
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "alloc_counter.hpp"
+#include "pets.hpp"
+
+namespace v1 {
+#include "v1_unique_ptr.hpp"
+}
+namespace v2 {
+#include "v2_with_stubs.hpp"
+}
+namespace v3 {
+#include "v3_type_erased.hpp"
+}
+namespace v4 {
+#include "v4_small_opt1.hpp"
+}
+namespace v5 {
+#include "v5_small_opt2.hpp"
+}
+namespace v6 {
+#include "v6_function_ptr.hpp"
+}
+namespace v7 {
+#include "v7_inline_vtable.hpp"
+}
+
+namespace {
+
+//
+// pets that know who they are
+//
+
+/// number of pets alive
+int g_livePets = 0;
+
+/// a pet with an id and @a T_Size bytes of payload that is checked on every access
+template <std::size_t T_Size>
+class Tagged : public IPet
+{
+public:
+    explicit Tagged(int id) : m_id(id)
+    {
+        std::memset(m_payload, id & 0xff, sizeof(m_payload));
+        ++g_livePets;
+    }
+    Tagged(Tagged&& rhs) noexcept : m_id(rhs.m_id)
+    {
+        std::memcpy(m_payload, rhs.m_payload, sizeof(m_payload));
+        ++g_livePets;
+    }
+    Tagged& operator=(Tagged&&) = delete;
+    ~Tagged() override { --g_livePets; }
+
+    std::string makeSomeNoise() override
+    {
+        for (unsigned char byte : m_payload)
+        {
+            if (byte != (m_id & 0xff))
+                return "corrupted";
+        }
+        return T_Size < 64 ? "small" + std::to_string(m_id) : "large" + std::to_string(m_id);
+    }
+
+private:
+    int m_id;
+    unsigned char m_payload[T_Size];
+};
+
+/// can't be moved -> always on the heap (not supported by v4 and v5)
+class Pinned : public IPet
+{
+public:
+    explicit Pinned(int id) : m_id(id) { ++g_livePets; }
+    Pinned(Pinned&&) = delete;
+    Pinned& operator=(Pinned&&) = delete;
+    ~Pinned() override { --g_livePets; }
+
+    std::string makeSomeNoise() override { return "pinned" + std::to_string(m_id); }
+
+private:
+    int m_id;
+};
+
+/// fits into all stack buffers
+using SmallPet = Tagged<8>;
+/// 64 bytes: inline for v6/v7, but not for v4/v5 (their storage adds a vtable pointer)
+using MediumPet = Tagged<52>;
+/// always on the heap
+using LargePet = Tagged<200>;
+
+enum class Kind
+{
+    small,
+    medium,
+    large,
+    pinned
+};
+
+
+//
+// the versions behind a common interface
+//
+
+/// emplace() for all versions (v1 has none)
+template <class Derived, class Ptr>
+void emplace(Ptr& ptr, int id)
+{
+    ptr.template emplace<Derived>(id);
+}
+template <class Derived>
+void emplace(v1::SmallPtr<IPet>& ptr, int id)
+{
+    ptr.reset(new Derived(id));
+}
+
+template <class Ptr>
+void emplace(Ptr& ptr, Kind kind, int id)
+{
+    switch (kind)
+    {
+    case Kind::small:
+        emplace<SmallPet>(ptr, id);
+        break;
+    case Kind::medium:
+        emplace<MediumPet>(ptr, id);
+        break;
+    case Kind::large:
+        emplace<LargePet>(ptr, id);
+        break;
+    case Kind::pinned:
+        if constexpr (!std::is_same<Ptr, v4::SmallPtr<IPet>>::value &&
+                      !std::is_same<Ptr, v5::SmallPtr<IPet>>::value)
+            emplace<Pinned>(ptr, id);
+        break;
+    }
+}
+
+/// what differs between the versions
+template <class Ptr>
+struct VersionTraits;
+
+template <>
+struct VersionTraits<v1::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v1";
+    static constexpr std::size_t heapAllocations = 1;
+};
+template <>
+struct VersionTraits<v2::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v2";
+    static constexpr std::size_t heapAllocations = 1;
+};
+template <>
+struct VersionTraits<v3::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v3";
+    /// the object and the storage that wraps it
+    static constexpr std::size_t heapAllocations = 2;
+};
+template <>
+struct VersionTraits<v4::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v4";
+    static constexpr std::size_t heapAllocations = 1;
+};
+template <>
+struct VersionTraits<v5::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v5";
+    static constexpr std::size_t heapAllocations = 1;
+};
+template <>
+struct VersionTraits<v6::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v6";
+    static constexpr std::size_t heapAllocations = 1;
+};
+template <>
+struct VersionTraits<v7::SmallPtr<IPet>>
+{
+    static constexpr const char* name = "v7";
+    static constexpr std::size_t heapAllocations = 1;
+};
+
+
+//
+// operations
+//
+
+constexpr std::size_t slotCount = 4;
+
+enum class Op
+{
+    emplace,
+    moveAssign,
+    moveConstruct,
+    reset,
+    get,
+    swap,
+    count
+};
+
+struct Step
+{
+    Op op;
+    std::size_t a;
+    std::size_t b;
+    Kind kind;
+};
+
+const char* opName(Op op)
+{
+    switch (op)
+    {
+    case Op::emplace:
+        return "emplace";
+    case Op::moveAssign:
+        return "moveAssign";
+    case Op::moveConstruct:
+        return "moveConstruct";
+    case Op::reset:
+        return "reset";
+    case Op::get:
+        return "get";
+    case Op::swap:
+        return "swap";
+    default:
+        return "?";
+    }
+}
+
+/// 2 bytes per step: operation and slots, kind of pet
+std::vector<Step> decode(const std::uint8_t* data, std::size_t size, bool pinned)
+{
+    std::vector<Step> steps;
+    for (std::size_t i = 0; i + 1 < size; i += 2)
+    {
+        Step step;
+        step.op = static_cast<Op>((data[i] & 7u) % static_cast<unsigned>(Op::count));
+        step.a = (data[i] >> 3) % slotCount;
+        step.b = (data[i] >> 5) % slotCount;
+        const unsigned kinds = pinned ? 4 : 3;
+        step.kind = static_cast<Kind>(data[i + 1] % kinds);
+        // moving from the destination isn't a meaningful operation (swapping with itself is)
+        if ((step.op == Op::moveAssign || step.op == Op::moveConstruct) && step.a == step.b)
+            step.b = (step.a + 1) % slotCount;
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+
+//
+// the model: the noise of the pet in each slot ("" if empty)
+//
+
+using Model = std::array<std::string, slotCount>;
+
+std::string noise(Kind kind, int id)
+{
+    switch (kind)
+    {
+    case Kind::small:
+    case Kind::medium:
+        return "small" + std::to_string(id);
+    case Kind::large:
+        return "large" + std::to_string(id);
+    case Kind::pinned:
+        return "pinned" + std::to_string(id);
+    }
+    return {};
+}
+
+void apply(Model& model, const Step& step, int id)
+{
+    switch (step.op)
+    {
+    case Op::emplace:
+        model[step.a] = noise(step.kind, id);
+        break;
+    case Op::moveAssign:
+    case Op::moveConstruct:
+        model[step.a] = std::move(model[step.b]);
+        model[step.b].clear();
+        break;
+    case Op::reset:
+        model[step.a].clear();
+        break;
+    case Op::swap:
+        std::swap(model[step.a], model[step.b]);
+        break;
+    default:
+        break;
+    }
+}
+
+int occupied(const Model& model)
+{
+    return static_cast<int>(
+      std::count_if(model.begin(), model.end(), [](const std::string& s) { return !s.empty(); }));
+}
+
+
+//
+// the slots of one version
+//
+
+template <class Ptr>
+class Slots
+{
+public:
+    using Traits = VersionTraits<Ptr>;
+
+    /// runs @a step, returns a description of what went wrong (empty if nothing)
+    std::string run(const Step& step, int id, const Model& before, const Model& after)
+    {
+        const int livePets = g_livePets;
+        const std::size_t allocations = allocationCount();
+        const std::size_t deallocations = deallocationCount();
+        apply(step, id);
+        const std::size_t allocated = allocationCount() - allocations;
+        const std::size_t freed = deallocationCount() - deallocations;
+        m_outstanding += allocated;
+        m_outstanding -= freed;
+
+        std::ostringstream error;
+        if (m_getMismatch)
+        {
+            error << "get() and get() const differ";
+        }
+        else if (g_livePets - livePets != occupied(after) - occupied(before))
+        {
+            error << "live pets changed by " << g_livePets - livePets << ", expected "
+                  << occupied(after) - occupied(before);
+        }
+        else if (step.op != Op::emplace && allocated != 0)
+        {
+            error << allocated << " allocations";
+        }
+        else if (step.op == Op::emplace &&
+                 allocated != (m_slots[step.a].usesHeap() ? Traits::heapAllocations : 0))
+        {
+            error << allocated << " allocations, but usesHeap() is "
+                  << m_slots[step.a].usesHeap();
+        }
+        else if (m_outstanding != expectedOutstanding())
+        {
+            error << m_outstanding << " outstanding allocations, expected "
+                  << expectedOutstanding();
+        }
+        else
+        {
+            for (std::size_t i = 0; i < slotCount; ++i)
+            {
+                const std::string actual = contents(i);
+                if (actual != after[i])
+                {
+                    error << "slot " << i << " holds \"" << actual << "\" instead of \""
+                          << after[i] << "\"";
+                    break;
+                }
+            }
+        }
+        return error.str();
+    }
+
+    /// empties all slots, returns a description of what went wrong (empty if nothing)
+    std::string clear()
+    {
+        const std::size_t deallocations = deallocationCount();
+        for (Ptr& slot : m_slots)
+            slot.reset();
+        m_outstanding -= deallocationCount() - deallocations;
+        if (m_outstanding != 0)
+            return std::to_string(m_outstanding) + " allocations leaked";
+        return {};
+    }
+
+private:
+    void apply(const Step& step, int id)
+    {
+        Ptr& a = m_slots[step.a];
+        Ptr& b = m_slots[step.b];
+        switch (step.op)
+        {
+        case Op::emplace:
+            emplace(a, step.kind, id);
+            break;
+        // like with the standard library, a moved-from SmallPtr is in a valid, but unspecified
+        // state (v1 - v3 swap on move assignment) -> reset it
+        case Op::moveAssign:
+            a = std::move(b);
+            b.reset();
+            break;
+        case Op::moveConstruct:
+            a.~Ptr();
+            ::new (static_cast<void*>(&a)) Ptr(std::move(b));
+            b.reset();
+            break;
+        case Op::reset:
+            a.reset();
+            break;
+        case Op::get:
+            m_getMismatch = a.get() != static_cast<const Ptr&>(a).get();
+            break;
+        case Op::swap:
+        {
+            // v4 and v5 only have std::swap()
+            using std::swap;
+            swap(a, b);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    std::string contents(std::size_t index)
+    {
+        Ptr& slot = m_slots[index];
+        if (!slot)
+            return slot.get() == nullptr ? std::string() : std::string("empty, but get() != null");
+        return slot->makeSomeNoise();
+    }
+
+    std::size_t expectedOutstanding() const
+    {
+        std::size_t outstanding = 0;
+        for (const Ptr& slot : m_slots)
+        {
+            if (slot.usesHeap() && slot != nullptr)
+                outstanding += Traits::heapAllocations;
+        }
+        return outstanding;
+    }
+
+    std::array<Ptr, slotCount> m_slots;
+    std::size_t m_outstanding = 0;
+    bool m_getMismatch = false;
+};
+
+
+/// runs the same steps on all versions @a Ptrs
+template <class... Ptrs>
+class Differential
+{
+public:
+    /// returns a description of the first difference (empty if there's none)
+    std::string run(const std::vector<Step>& steps)
+    {
+        const int livePets = g_livePets;
+        Model model;
+        int id = 0;
+        std::string error;
+        for (std::size_t i = 0; i < steps.size() && error.empty(); ++i)
+        {
+            const Step& step = steps[i];
+            Model next = model;
+            ::apply(next, step, ++id);
+
+            std::ostringstream where;
+            where << "step " << i << " (" << opName(step.op) << ' ' << step.a << ' ' << step.b
+                  << ")";
+            std::apply(
+              [&](auto&... slots) {
+                  ((error.empty() ? void(error = describe(slots, where.str(),
+                                                          slots.run(step, id, model, next)))
+                                  : void()),
+                   ...);
+              },
+              m_slots);
+            model = std::move(next);
+        }
+
+        if (error.empty())
+        {
+            std::apply(
+              [&](auto&... slots) {
+                  ((error.empty() ? void(error = describe(slots, "end", slots.clear())) : void()),
+                   ...);
+              },
+              m_slots);
+        }
+        if (error.empty() && g_livePets != livePets)
+            error = std::to_string(g_livePets - livePets) + " pets alive at the end";
+        return error;
+    }
+
+private:
+    template <class Slots>
+    static std::string describe(const Slots&, const std::string& where, const std::string& error)
+    {
+        if (error.empty())
+            return error;
+        return std::string(Slots::Traits::name) + ", " + where + ": " + error;
+    }
+
+    std::tuple<Slots<Ptrs>...> m_slots;
+};
+
+/// all versions with movable pets, all but v4 and v5 with non-movable ones too
+std::string runSequence(const std::uint8_t* data, std::size_t size)
+{
+    std::string error =
+      Differential<v1::SmallPtr<IPet>, v2::SmallPtr<IPet>, v3::SmallPtr<IPet>, v4::SmallPtr<IPet>,
+                   v5::SmallPtr<IPet>, v6::SmallPtr<IPet>, v7::SmallPtr<IPet>>{}
+        .run(decode(data, size, false));
+    if (error.empty())
+    {
+        error = Differential<v1::SmallPtr<IPet>, v2::SmallPtr<IPet>, v3::SmallPtr<IPet>,
+                             v6::SmallPtr<IPet>, v7::SmallPtr<IPet>>{}
+                  .run(decode(data, size, true));
+    }
+    return error;
+}
+
+} // namespace
+
+
+#ifdef SMALLPTR_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    const std::string error = runSequence(data, size);
+    if (!error.empty())
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+#include <gtest/gtest.h>
+
+std::vector<std::uint8_t> encode(std::initializer_list<Step> steps)
+{
+    std::vector<std::uint8_t> data;
+    for (const Step& step : steps)
+    {
+        data.push_back(static_cast<std::uint8_t>(static_cast<unsigned>(step.op) |
+                                                 (step.a << 3) | (step.b << 5)));
+        data.push_back(static_cast<std::uint8_t>(step.kind));
+    }
+    return data;
+}
+
+TEST(Differential, Decode)
+{
+    const std::vector<std::uint8_t> data =
+      encode({ { Op::emplace, 1, 0, Kind::large }, { Op::swap, 2, 3, Kind::small } });
+    const std::vector<Step> steps = decode(data.data(), data.size(), true);
+    ASSERT_EQ(steps.size(), 2u);
+    EXPECT_EQ(steps[0].op, Op::emplace);
+    EXPECT_EQ(steps[0].a, 1u);
+    EXPECT_EQ(steps[0].kind, Kind::large);
+    EXPECT_EQ(steps[1].op, Op::swap);
+    EXPECT_EQ(steps[1].a, 2u);
+    EXPECT_EQ(steps[1].b, 3u);
+}
+
+TEST(Differential, MoveAssignReplaces)
+{
+    // v4 and v5 used to leak the object of the target
+    const std::vector<std::uint8_t> data =
+      encode({ { Op::emplace, 0, 0, Kind::large },
+               { Op::emplace, 1, 0, Kind::small },
+               { Op::moveAssign, 0, 1, Kind::small },
+               { Op::emplace, 1, 0, Kind::medium },
+               { Op::moveAssign, 0, 1, Kind::small } });
+    EXPECT_EQ(runSequence(data.data(), data.size()), "");
+}
+
+TEST(Differential, Swap)
+{
+    const std::vector<std::uint8_t> data = encode({ { Op::emplace, 0, 0, Kind::small },
+                                                    { Op::emplace, 1, 0, Kind::pinned },
+                                                    { Op::swap, 0, 1, Kind::small },
+                                                    { Op::swap, 0, 0, Kind::small },
+                                                    { Op::emplace, 2, 0, Kind::medium },
+                                                    { Op::swap, 2, 3, Kind::small },
+                                                    { Op::swap, 3, 1, Kind::small } });
+    EXPECT_EQ(runSequence(data.data(), data.size()), "");
+}
+
+TEST(Differential, Random)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int sequence = 0; sequence < 2000; ++sequence)
+    {
+        std::vector<std::uint8_t> data(64);
+        for (std::uint8_t& value : data)
+            value = static_cast<std::uint8_t>(byte(random));
+        const std::string error = runSequence(data.data(), data.size());
+        ASSERT_EQ(error, "") << "sequence " << sequence;
+    }
+}
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @file    mpsc_queue.hpp
+ * @brief   bounded lock-free multi-producer/single-consumer queue of polymorphic messages
+ *
+ * Every slot of the ring buffer is a SmallPtr, so producers construct their messages directly in
+ * the slot and the consumer handles them in place. As long as the messages fit into the stack
+ * buffer, there's no allocation at all.
+ *
+ * The algorithm is D. Vyukov's bounded queue: each slot has a sequence number that tells whether
+ * it's free for the producer of a given position or ready for the consumer.
+ */
+
+#pragma once
+
+#include "v6_function_ptr.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <class T, std::size_t T_Capacity, std::size_t T_StackSize = 64>
+class MpscQueue
+{
+public:
+    using Ptr = SmallPtr<T, T_StackSize>;
+    static_assert(T_Capacity >= 2 && (T_Capacity & (T_Capacity - 1)) == 0,
+                  "capacity must be a power of 2");
+    static constexpr std::size_t cacheLineSize = 64;
+
+    MpscQueue() : m_slots(new Slot[T_Capacity]), m_dequeuePos(0)
+    {
+        for (std::size_t i = 0; i < T_Capacity; ++i)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        m_enqueuePos.value.store(0, std::memory_order_relaxed);
+    }
+
+    // not copyable, not movable (producers may hold references)
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    static constexpr std::size_t capacity() noexcept { return T_Capacity; }
+
+    /**
+     * Constructs a message in the next free slot (may be called by any thread).
+     * @return false if the queue is full
+     */
+    template <class Derived, class... Args>
+    bool tryEmplace(Args&&... args)
+    {
+        std::size_t pos = m_enqueuePos.value.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = m_slots[pos & mask];
+            const std::size_t seq = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                // the slot is free -> try to claim it
+                if (m_enqueuePos.value.compare_exchange_weak(pos, pos + 1,
+                                                             std::memory_order_relaxed))
+                {
+                    publish(slot, pos, [&] {
+                        slot.message.template emplace<Derived>(std::forward<Args>(args)...);
+                    });
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the consumer hasn't freed the slot yet
+                return false;
+            }
+            else
+            {
+                // another producer claimed the slot
+                pos = m_enqueuePos.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Calls @a handler with the oldest message (as T&), which is destroyed afterwards.
+     * May only be called by the consumer thread.
+     * @return false if the queue is empty
+     */
+    template <class Handler>
+    bool tryConsume(Handler&& handler)
+    {
+        return consumeSlot([&handler](Ptr& message) { handler(*message); });
+    }
+
+    /// moves the oldest message to @a out (consumer only)
+    bool tryPop(Ptr& out)
+    {
+        return consumeSlot([&out](Ptr& message) { out = std::move(message); });
+    }
+
+    /**
+     * Whether there are no messages. May only be called by the consumer thread, like tryPop():
+     * it reads the consumer's position without synchronization. Messages that are being
+     * constructed count as well, so it's only exact if no producer is active.
+     */
+    bool empty() const noexcept
+    {
+        return m_enqueuePos.value.load(std::memory_order_acquire) == m_dequeuePos;
+    }
+
+private:
+    static constexpr std::size_t mask = T_Capacity - 1;
+
+    struct alignas(cacheLineSize) Slot
+    {
+        std::atomic<std::size_t> sequence;
+        Ptr message;
+    };
+
+    struct alignas(cacheLineSize) PaddedPos
+    {
+        std::atomic<std::size_t> value;
+    };
+
+    /// runs @a construct and marks the slot as ready - even if the construction failed
+    template <class Construct>
+    static void publish(Slot& slot, std::size_t pos, Construct construct)
+    {
+        struct Publish
+        {
+            Slot& slot;
+            std::size_t pos;
+            ~Publish() { slot.sequence.store(pos + 1, std::memory_order_release); }
+        } publish{ slot, pos };
+        construct();
+    }
+
+    template <class Handler>
+    bool consumeSlot(Handler handler)
+    {
+        for (;;)
+        {
+            Slot& slot = m_slots[m_dequeuePos & mask];
+            const std::size_t seq = slot.sequence.load(std::memory_order_acquire);
+            if (seq != m_dequeuePos + 1)
+                return false;
+
+            // hand the slot back to the producers, even if the handler throws
+            struct Release
+            {
+                Slot& slot;
+                std::size_t& pos;
+                ~Release()
+                {
+                    slot.message.reset();
+                    slot.sequence.store(pos + T_Capacity, std::memory_order_release);
+                    ++pos;
+                }
+            } release{ slot, m_dequeuePos };
+
+            // an empty slot means that the constructor of the message threw -> skip it
+            if (slot.message)
+            {
+                handler(slot.message);
+                return true;
+            }
+        }
+    }
+
+    std::unique_ptr<Slot[]> m_slots;
+    PaddedPos m_enqueuePos;
+    // only used by the consumer -> on its own cache line
+    alignas(cacheLineSize) std::size_t m_dequeuePos;
+};
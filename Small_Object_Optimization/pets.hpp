@@ -8,6 +8,8 @@
 
 #include <string>
 
+#include "trivially_relocatable.hpp"
+
 
 /// Generic 'pet' interface.
 class IPet
@@ -43,6 +45,12 @@ public:
     std::string makeSomeNoise() final { return "Meow!"; }
 };
 
+/// a cat has nothing but a vtable pointer -> may be moved by copying its bytes
+template <>
+struct IsTriviallyRelocatable<Cat> : std::true_type
+{
+};
+
 class Parrot : public IPet
 {
 public:
@@ -0,0 +1,394 @@
+/**
+ * @file    poly_vector.hpp
+ * @brief   container that packs objects of different sub-classes of T into one buffer
+ *
+ * Each element only takes the space it needs (plus alignment), instead of the full stack buffer
+ * of a SmallPtr. Elements are managed by the same storage functions as SmallPtr in
+ * v6_function_ptr.hpp: small movable objects are stored in the buffer, everything else on the
+ * heap with a pointer in the buffer.
+ */
+
+#pragma once
+
+#include "v6_function_ptr.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <class T, size_t T_MaxInline = 64>
+class PolyVector
+{
+private:
+    static_assert(!std::is_array<T>::value, "arrays not supported");
+    static_assert(T_MaxInline >= sizeof(T*), "must at least hold a pointer");
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    using Params = typename ParamTypes<T>::Param;
+    using StorageFunc = void (*)(Action, Params&);
+
+    /// where to find an element in the buffer and how to handle it
+    struct Entry
+    {
+        std::size_t offset;
+        std::uint32_t size;
+        std::uint32_t alignment;
+        StorageFunc func;
+    };
+
+    std::vector<Entry> m_entries;
+    unsigned char* m_data;
+    std::size_t m_used;
+    std::size_t m_capacity;
+
+    // tag dispatching
+    struct inline_tag
+    {
+    };
+    struct heap_tag
+    {
+    };
+
+    static std::size_t alignUp(std::size_t offset, std::size_t align)
+    {
+        return (offset + align - 1) & ~(align - 1);
+    }
+
+    T* getPtr(const Entry& entry) const noexcept
+    {
+        Params p;
+        p.getNonConst.stack = m_data + entry.offset;
+        entry.func(Action::get_nonconst, p);
+        return p.getNonConst.ptr;
+    }
+
+    /// moves an element to another place (which must not overlap) and destroys the source
+    static void relocate(const Entry& entry, void* from, void* to)
+    {
+        Params p;
+        p.moveTo.stackFrom = from;
+        p.moveTo.stackTo = to;
+        entry.func(Action::move_to, p);
+    }
+    static void destroy(const Entry& entry, void* where) noexcept
+    {
+        Params p;
+        p.destroy.stack = where;
+        entry.func(Action::destroy, p);
+    }
+
+public:
+    template <class Ref>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::remove_reference_t<Ref>*;
+        using reference = Ref;
+
+        Iterator() noexcept : m_vec(nullptr), m_index(0) {}
+        Iterator(const PolyVector* vec, std::size_t index) noexcept : m_vec(vec), m_index(index)
+        {
+        }
+        // iterator -> const_iterator
+        template <class OtherRef>
+        Iterator(const Iterator<OtherRef>& rhs) noexcept
+          : m_vec(rhs.m_vec), m_index(rhs.m_index)
+        {
+        }
+
+        reference operator*() const noexcept { return *m_vec->getPtr(m_vec->m_entries[m_index]); }
+        pointer operator->() const noexcept { return m_vec->getPtr(m_vec->m_entries[m_index]); }
+
+        Iterator& operator++() noexcept
+        {
+            ++m_index;
+            return *this;
+        }
+        Iterator operator++(int) noexcept { return Iterator(m_vec, m_index++); }
+        Iterator& operator--() noexcept
+        {
+            --m_index;
+            return *this;
+        }
+        Iterator operator--(int) noexcept { return Iterator(m_vec, m_index--); }
+        Iterator& operator+=(difference_type n) noexcept
+        {
+            m_index = static_cast<std::size_t>(static_cast<difference_type>(m_index) + n);
+            return *this;
+        }
+        Iterator& operator-=(difference_type n) noexcept { return *this += -n; }
+        Iterator operator+(difference_type n) const noexcept { return Iterator(*this) += n; }
+        Iterator operator-(difference_type n) const noexcept { return Iterator(*this) -= n; }
+        difference_type operator-(const Iterator& rhs) const noexcept
+        {
+            return static_cast<difference_type>(m_index) -
+                   static_cast<difference_type>(rhs.m_index);
+        }
+
+        bool operator==(const Iterator& rhs) const noexcept { return m_index == rhs.m_index; }
+        bool operator!=(const Iterator& rhs) const noexcept { return m_index != rhs.m_index; }
+
+    private:
+        template <class>
+        friend class Iterator;
+        friend class PolyVector;
+
+        const PolyVector* m_vec;
+        std::size_t m_index;
+    };
+    using iterator = Iterator<T&>;
+    using const_iterator = Iterator<const T&>;
+
+    PolyVector() noexcept : m_data(nullptr), m_used(0), m_capacity(0) {}
+    ~PolyVector()
+    {
+        clear();
+        deallocate(m_data);
+    }
+
+    PolyVector(PolyVector&& rhs) noexcept
+      : m_entries(std::move(rhs.m_entries)), m_data(rhs.m_data), m_used(rhs.m_used),
+        m_capacity(rhs.m_capacity)
+    {
+        rhs.m_entries.clear();
+        rhs.m_data = nullptr;
+        rhs.m_used = 0;
+        rhs.m_capacity = 0;
+    }
+    PolyVector& operator=(PolyVector&& rhs) noexcept
+    {
+        PolyVector tmp(std::move(rhs));
+        swap(tmp);
+        return *this;
+    }
+    // disable copying
+    PolyVector(const PolyVector&) = delete;
+    PolyVector& operator=(const PolyVector&) = delete;
+
+    void swap(PolyVector& rhs) noexcept
+    {
+        m_entries.swap(rhs.m_entries);
+        std::swap(m_data, rhs.m_data);
+        std::swap(m_used, rhs.m_used);
+        std::swap(m_capacity, rhs.m_capacity);
+    }
+
+    // access
+    iterator begin() noexcept { return iterator(this, 0); }
+    iterator end() noexcept { return iterator(this, size()); }
+    const_iterator begin() const noexcept { return const_iterator(this, 0); }
+    const_iterator end() const noexcept { return const_iterator(this, size()); }
+
+    T& operator[](std::size_t index) noexcept { return *getPtr(m_entries[index]); }
+    const T& operator[](std::size_t index) const noexcept { return *getPtr(m_entries[index]); }
+
+    bool usesHeap(std::size_t index) const noexcept
+    {
+        Params p;
+        m_entries[index].func(Action::uses_heap, p);
+        return p.usesHeap.value;
+    }
+
+    // size
+    std::size_t size() const noexcept { return m_entries.size(); }
+    bool empty() const noexcept { return m_entries.empty(); }
+    /// number of bytes used in the buffer
+    std::size_t bytesUsed() const noexcept { return m_used; }
+    std::size_t bytesCapacity() const noexcept { return m_capacity; }
+
+    /// reserve space for @a elements elements and @a bytes bytes in the buffer
+    void reserve(std::size_t elements, std::size_t bytes)
+    {
+        m_entries.reserve(elements);
+        if (bytes > m_capacity)
+            grow(bytes);
+    }
+
+    // modifiers
+    template <class Derived, class... Args>
+    Derived& emplace_back(Args&&... args)
+    {
+        static_assert(std::is_same<T, Derived>::value or std::is_base_of<T, Derived>::value,
+                      "may only use sub-classes of T!");
+        static_assert(std::is_constructible<Derived, Args...>::value, "cannot instantiate!");
+
+        constexpr bool fitsInline = (sizeof(Derived) <= T_MaxInline) &&
+                                    (alignof(Derived) <= alignment) &&
+                                    std::is_move_constructible<Derived>::value;
+        return emplaceImpl<Derived>(std::conditional_t<fitsInline, inline_tag, heap_tag>{},
+                                    std::forward<Args>(args)...);
+    }
+
+    void pop_back() noexcept
+    {
+        const Entry& entry = m_entries.back();
+        destroy(entry, m_data + entry.offset);
+        m_used = entry.offset;
+        m_entries.pop_back();
+    }
+
+    /**
+     * Removes one element, the following elements are moved to close the gap. If moving one of
+     * them throws, the element is erased nevertheless, the rest of the gap just isn't closed.
+     * (An element is only lost if moving it back to its old place throws as well.)
+     */
+    iterator erase(const_iterator pos)
+    {
+        const std::size_t index = pos.m_index;
+        const Entry erased = m_entries[index];
+        destroy(erased, m_data + erased.offset);
+        m_entries.erase(m_entries.begin() + static_cast<std::ptrdiff_t>(index));
+
+        std::size_t used = erased.offset;
+        for (std::size_t i = index; i < m_entries.size(); ++i)
+        {
+            Entry& entry = m_entries[i];
+            const std::size_t offset = alignUp(used, entry.alignment);
+            // until the gap is closed, m_used still covers all elements
+            if (offset != entry.offset)
+                moveDown(i, offset);
+            used = offset + entry.size;
+        }
+        m_used = used;
+        return iterator(this, index);
+    }
+
+    void clear() noexcept
+    {
+        for (const Entry& entry : m_entries)
+            destroy(entry, m_data + entry.offset);
+        m_entries.clear();
+        m_used = 0;
+    }
+
+private:
+    template <class Derived, class... Args>
+    Derived& emplaceImpl(inline_tag, Args&&... args)
+    {
+        void* where = allocate(sizeof(Derived), alignof(Derived));
+        Derived* ptr = ::new (where) Derived(std::forward<Args>(args)...);
+        commit(sizeof(Derived), alignof(Derived), StackStorage<Derived, T>::execute);
+        return *ptr;
+    }
+    template <class Derived, class... Args>
+    Derived& emplaceImpl(heap_tag, Args&&... args)
+    {
+        void* where = allocate(sizeof(Derived*), alignof(Derived*));
+        Derived* ptr = new Derived(std::forward<Args>(args)...);
+        HeapStorage<Derived, T>::set(where, ptr);
+        commit(sizeof(Derived*), alignof(Derived*), HeapStorage<Derived, T>::execute);
+        return *ptr;
+    }
+
+    /// makes sure there's space for an object, returns where it will be constructed
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        // reserve the entry first, so commit() can't throw
+        if (m_entries.size() == m_entries.capacity())
+            m_entries.reserve(m_entries.empty() ? 16 : 2 * m_entries.size());
+        const std::size_t offset = alignUp(m_used, align);
+        if (offset + size > m_capacity)
+            grow(offset + size);
+        return m_data + offset;
+    }
+    void commit(std::size_t size, std::size_t align, StorageFunc func) noexcept
+    {
+        const std::size_t offset = alignUp(m_used, align);
+        m_entries.push_back(Entry{ offset, static_cast<std::uint32_t>(size),
+                                   static_cast<std::uint32_t>(align), func });
+        m_used = offset + size;
+    }
+
+    /**
+     * Re-allocates the buffer, the offsets stay the same. If moving an element throws, the
+     * elements that have been moved already are moved back (an element is only lost if that
+     * throws as well).
+     */
+    void grow(std::size_t minCapacity)
+    {
+        std::size_t capacity = m_capacity ? 2 * m_capacity : 256;
+        while (capacity < minCapacity)
+            capacity *= 2;
+
+        unsigned char* data =
+          static_cast<unsigned char*>(::operator new(capacity, std::align_val_t(alignment)));
+        std::size_t moved = 0;
+        try
+        {
+            for (; moved < m_entries.size(); ++moved)
+            {
+                const Entry& entry = m_entries[moved];
+                relocate(entry, m_data + entry.offset, data + entry.offset);
+            }
+        }
+        catch (...)
+        {
+            // backwards, so that erasing a lost element doesn't change the remaining indexes
+            while (moved-- > 0)
+                moveBack(moved, data + m_entries[moved].offset, m_data + m_entries[moved].offset);
+            deallocate(data);
+            throw;
+        }
+        deallocate(m_data);
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    /**
+     * Moves element @a index back to where it was, after moving it from there has failed.
+     * If that throws as well, the element is destroyed and removed.
+     */
+    void moveBack(std::size_t index, void* from, void* to) noexcept
+    {
+        const Entry& entry = m_entries[index];
+        try
+        {
+            relocate(entry, from, to);
+        }
+        catch (...)
+        {
+            destroy(entry, from);
+            m_entries.erase(m_entries.begin() + static_cast<std::ptrdiff_t>(index));
+        }
+    }
+    static void deallocate(unsigned char* data) noexcept
+    {
+        if (data)
+            ::operator delete(data, std::align_val_t(alignment));
+    }
+
+    /// move an element to a lower offset, source and destination may overlap
+    void moveDown(std::size_t index, std::size_t offset)
+    {
+        Entry& entry = m_entries[index];
+        unsigned char* from = m_data + entry.offset;
+        unsigned char* to = m_data + offset;
+        if (to + entry.size > from)
+        {
+            // overlapping -> go via a temporary buffer
+            typename std::aligned_storage<T_MaxInline, alignment>::type tmp;
+            relocate(entry, from, &tmp);
+            try
+            {
+                relocate(entry, &tmp, to);
+            }
+            catch (...)
+            {
+                moveBack(index, &tmp, from);
+                throw;
+            }
+        }
+        else
+        {
+            relocate(entry, from, to);
+        }
+        entry.offset = offset;
+    }
+};
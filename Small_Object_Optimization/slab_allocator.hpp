@@ -0,0 +1,165 @@
+/**
+ * @file    slab_allocator.hpp
+ * @brief   allocator that takes single objects from SlabPools, grouped by size class
+ *
+ * Meant for the heap fallback of SmallPtr: with SmallPtr<IPet, 64, SlabAllocator<IPet>>, a Parrot
+ * doesn't need a malloc()/free() pair anymore, but takes a block from the pool of its size class.
+ * Up to 64 bytes, the size classes are 16 bytes apart, above there are 4 size classes per power
+ * of 2 (..., 256, 320, 384, 448, 512, ...), so rounding up wastes less than 20% of a block.
+ * Types of the same size class share a pool.
+ *
+ * Arrays, objects larger than 4 KiB and over-aligned objects are allocated with operator new.
+ */
+
+#pragma once
+
+#include "slab_pool.hpp"
+
+#include <cstddef>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+/// the size classes of SlabAllocator
+class SlabSizeClasses
+{
+public:
+    static constexpr std::size_t minSize = 16;
+    static constexpr std::size_t maxSize = 4096;
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    /// block size for @a bytes (which must be at most maxSize)
+    static constexpr std::size_t roundUp(std::size_t bytes) noexcept
+    {
+        if (bytes <= 4 * minSize)
+            return bytes <= minSize ? minSize : (bytes + minSize - 1) / minSize * minSize;
+        // 4 classes between pow2 and 2 * pow2
+        std::size_t pow2 = 4 * minSize;
+        while (2 * pow2 < bytes)
+            pow2 *= 2;
+        const std::size_t step = pow2 / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    static constexpr std::size_t count() noexcept { return indexOf(maxSize) + 1; }
+
+    /// block size of the size class @a index
+    static constexpr std::size_t sizeAt(std::size_t index) noexcept
+    {
+        if (index < 4)
+            return (index + 1) * minSize;
+        const std::size_t pow2 = (4 * minSize) << ((index - 4) / 4);
+        return pow2 + ((index - 4) % 4 + 1) * (pow2 / 4);
+    }
+
+    static constexpr std::size_t indexOf(std::size_t bytes) noexcept
+    {
+        std::size_t index = 0;
+        while (sizeAt(index) < bytes)
+            ++index;
+        return index;
+    }
+
+    template <std::size_t T_Size>
+    using Pool = SlabPool<T_Size, alignment>;
+
+    /// statistics of all size classes that have been used
+    static std::vector<SlabStats> stats()
+    {
+        return stats(std::make_index_sequence<count()>{});
+    }
+
+    /// prints a table with the statistics of all used size classes
+    static void dump(std::ostream& os)
+    {
+        os << std::setw(8) << "block" << std::setw(8) << "chunks" << std::setw(10) << "blocks"
+           << std::setw(10) << "used" << std::setw(12) << "occupancy" << std::setw(15)
+           << "fragmentation" << '\n';
+        for (const SlabStats& pool : stats())
+        {
+            os << std::setw(8) << pool.blockSize << std::setw(8) << pool.chunks << std::setw(10)
+               << pool.blocks << std::setw(10) << pool.used << std::setw(11) << std::fixed
+               << std::setprecision(1) << 100.0 * pool.occupancy() << '%' << std::setw(14)
+               << 100.0 * pool.fragmentation() << '%' << '\n';
+        }
+    }
+
+private:
+    template <std::size_t... I>
+    static std::vector<SlabStats> stats(std::index_sequence<I...>)
+    {
+        std::vector<SlabStats> all{ Pool<sizeAt(I)>::stats()... };
+        std::vector<SlabStats> used;
+        for (const SlabStats& pool : all)
+        {
+            if (pool.chunks)
+                used.push_back(pool);
+        }
+        return used;
+    }
+};
+
+/// stateless allocator, all instances are interchangeable
+template <class T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    SlabAllocator() noexcept = default;
+    template <class U>
+    SlabAllocator(const SlabAllocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if constexpr (pooled())
+        {
+            if (n == 1)
+                return static_cast<T*>(Pool<T>::allocate(sizeof(T)));
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        if constexpr (pooled())
+        {
+            if (n == 1)
+            {
+                Pool<T>::deallocate(ptr, sizeof(T));
+                return;
+            }
+        }
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    /// block size used for single objects (0 if they don't come from a pool)
+    static constexpr std::size_t blockSize() noexcept
+    {
+        return pooled() ? SlabSizeClasses::roundUp(sizeof(T)) : 0;
+    }
+
+private:
+    // functions and a template, because T may be incomplete here (see HeapBlock)
+    static constexpr bool pooled() noexcept
+    {
+        return sizeof(T) <= SlabSizeClasses::maxSize && alignof(T) <= SlabSizeClasses::alignment;
+    }
+    template <class U>
+    using Pool = SlabSizeClasses::Pool<SlabSizeClasses::roundUp(sizeof(U))>;
+};
+
+template <class T, class U>
+bool operator==(const SlabAllocator<T>&, const SlabAllocator<U>&) noexcept
+{
+    return true;
+}
+template <class T, class U>
+bool operator!=(const SlabAllocator<T>&, const SlabAllocator<U>&) noexcept
+{
+    return false;
+}
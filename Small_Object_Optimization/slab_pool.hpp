@@ -0,0 +1,333 @@
+/**
+ * @file    slab_pool.hpp
+ * @brief   pool of fixed-size blocks, carved from larger chunks
+ *
+ * Freed blocks are kept in a thread-local free list, so allocating and freeing doesn't need any
+ * synchronization. If the list of a thread grows too long (e.g. a consumer that frees what other
+ * threads allocated), a batch of blocks is handed to a global refill list. Threads that run out
+ * of blocks take a batch from there before a new chunk is allocated. Only these two cases take a
+ * lock. Chunks are never given back before the program ends, because blocks may still be in use
+ * by other threads (or static objects).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/// snapshot of the state of one SlabPool
+struct SlabStats
+{
+    std::size_t blockSize = 0;
+    std::size_t chunks = 0;
+    /// blocks in all chunks
+    std::size_t blocks = 0;
+    /// blocks currently allocated
+    std::size_t used = 0;
+    /// bytes requested for the allocated blocks (at most used * blockSize)
+    std::size_t requestedBytes = 0;
+    /// free blocks in the global refill list (the rest is cached by the threads)
+    std::size_t refillBlocks = 0;
+
+    /// part of the blocks that is allocated
+    double occupancy() const noexcept
+    {
+        return blocks ? static_cast<double>(used) / static_cast<double>(blocks) : 0.0;
+    }
+    /// part of the allocated memory that is lost by rounding up to the block size
+    double fragmentation() const noexcept
+    {
+        const std::size_t allocated = used * blockSize;
+        return allocated ? 1.0 - static_cast<double>(requestedBytes) /
+                                   static_cast<double>(allocated)
+                         : 0.0;
+    }
+};
+
+template <std::size_t T_Size, std::size_t T_Align = alignof(std::max_align_t)>
+class SlabPool
+{
+private:
+    union Node
+    {
+        Node* next;
+        alignas(T_Align) unsigned char data[T_Size];
+    };
+
+public:
+    static constexpr std::size_t blockSize = sizeof(Node);
+    /// chunks of about 64 KiB
+    static constexpr std::size_t blocksPerChunk =
+      std::max<std::size_t>(16, (64 * 1024) / sizeof(Node));
+    /// number of blocks passed between a thread and the refill list at once
+    static constexpr std::size_t batchSize = 32;
+
+    /// @a bytes is only used for the statistics
+    static void* allocate(std::size_t bytes = T_Size)
+    {
+        Cache& cache = localCache();
+        if (cache.state != Cache::attached || !cache.head)
+            return allocateSlow(cache, bytes);
+
+        Node* node = cache.head;
+        cache.head = node->next;
+        add(cache.freeBlocks, std::size_t(0) - 1);
+        add(cache.requestedBytes, bytes);
+        return node;
+    }
+
+    static void deallocate(void* ptr, std::size_t bytes = T_Size) noexcept
+    {
+        Node* node = static_cast<Node*>(ptr);
+        Cache& cache = localCache();
+        if (cache.state != Cache::attached)
+        {
+            deallocateSlow(cache, node, bytes);
+            return;
+        }
+
+        node->next = cache.head;
+        cache.head = node;
+        add(cache.freeBlocks, 1);
+        add(cache.requestedBytes, std::size_t(0) - bytes);
+        if (cache.freeBlocks.load(std::memory_order_relaxed) > 2 * batchSize)
+            spill(cache);
+    }
+
+    /// exact if no other thread uses the pool at the same time
+    static SlabStats stats()
+    {
+        Global& global = globalState();
+        std::lock_guard<std::mutex> lock(global.mutex);
+
+        SlabStats stats;
+        stats.blockSize = blockSize;
+        stats.chunks = global.chunks.size();
+        stats.blocks = stats.chunks * blocksPerChunk;
+        stats.refillBlocks = global.refillBlocks;
+
+        std::size_t freeBlocks = global.refillBlocks;
+        std::size_t requestedBytes = global.requestedBytes;
+        for (const Cache* cache = global.caches; cache; cache = cache->next)
+        {
+            freeBlocks += cache->freeBlocks.load(std::memory_order_relaxed);
+            requestedBytes += cache->requestedBytes.load(std::memory_order_relaxed);
+        }
+        stats.used = stats.blocks - freeBlocks;
+        stats.requestedBytes = requestedBytes;
+        return stats;
+    }
+
+private:
+    /// free blocks of one thread (the counters are written by the thread, read by stats())
+    struct Cache
+    {
+        enum State
+        {
+            unattached, ///< not yet registered
+            attached,   ///< registered, uses its free list
+            detached    ///< thread is exiting, goes straight to the global state
+        };
+
+        Node* head = nullptr;
+        std::atomic<std::size_t> freeBlocks{ 0 };
+        /// the sum may wrap around, if other threads free the blocks of this one
+        std::atomic<std::size_t> requestedBytes{ 0 };
+        Cache* next = nullptr;
+        State state = unattached;
+    };
+
+    struct Batch
+    {
+        Node* head;
+        std::size_t count;
+    };
+
+    struct Global
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Node[]>> chunks;
+        std::vector<Batch> refill;
+        std::size_t refillBlocks = 0;
+        /// all attached caches
+        Cache* caches = nullptr;
+        /// requested bytes of detached threads
+        std::size_t requestedBytes = 0;
+    };
+
+    /// returns the caches of exiting threads to the global state
+    struct Detach
+    {
+        Cache& cache;
+        ~Detach() { detach(cache); }
+    };
+
+    // trivially destructible -> may still be used while other thread_locals are destroyed
+    static Cache& localCache() noexcept
+    {
+        static thread_local Cache cache;
+        return cache;
+    }
+
+    static Global& globalState()
+    {
+        // intentionally leaked: there may be blocks in use until the very end
+        static Global* const global = new Global;
+        return *global;
+    }
+
+    /// only written by the owning thread -> no read-modify-write needed
+    static void add(std::atomic<std::size_t>& counter, std::size_t value) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static void* allocateSlow(Cache& cache, std::size_t bytes)
+    {
+        if (cache.state == Cache::unattached)
+            attach(cache);
+
+        Global& global = globalState();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        Batch batch = takeBatch(global);
+        Node* node = batch.head;
+        batch.head = node->next;
+        --batch.count;
+
+        if (cache.state == Cache::detached)
+        {
+            if (batch.count)
+                putBatch(global, batch); // the blocks are lost if this fails
+            global.requestedBytes += bytes;
+        }
+        else
+        {
+            cache.head = batch.head;
+            add(cache.freeBlocks, batch.count);
+            add(cache.requestedBytes, bytes);
+        }
+        return node;
+    }
+
+    static void deallocateSlow(Cache& cache, Node* node, std::size_t bytes) noexcept
+    {
+        if (cache.state == Cache::unattached)
+        {
+            try
+            {
+                attach(cache);
+            }
+            catch (...)
+            {
+                // can't register the thread -> treat it like an exiting one
+                cache.state = Cache::detached;
+            }
+            if (cache.state == Cache::attached)
+            {
+                deallocate(node, bytes);
+                return;
+            }
+        }
+
+        Global& global = globalState();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        node->next = nullptr;
+        putBatch(global, Batch{ node, 1 }); // the block is lost if this fails
+        global.requestedBytes -= bytes;
+    }
+
+    /// moves a batch of blocks from the thread's list to the refill list
+    static void spill(Cache& cache) noexcept
+    {
+        Node* last = cache.head;
+        for (std::size_t i = 1; i < batchSize; ++i)
+            last = last->next;
+
+        Global& global = globalState();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        if (putBatch(global, Batch{ cache.head, batchSize }))
+        {
+            cache.head = last->next;
+            last->next = nullptr;
+            add(cache.freeBlocks, std::size_t(0) - batchSize);
+        }
+    }
+
+    /// takes a batch from the refill list, or makes one from a new chunk (requires the lock)
+    static Batch takeBatch(Global& global)
+    {
+        if (!global.refill.empty())
+        {
+            Batch batch = global.refill.back();
+            global.refill.pop_back();
+            global.refillBlocks -= batch.count;
+            return batch;
+        }
+
+        std::unique_ptr<Node[]> chunk(new Node[blocksPerChunk]);
+        for (std::size_t i = 0; i + 1 < blocksPerChunk; ++i)
+            chunk[i].next = &chunk[i + 1];
+        chunk[blocksPerChunk - 1].next = nullptr;
+        global.chunks.push_back(std::move(chunk));
+        return Batch{ global.chunks.back().get(), blocksPerChunk };
+    }
+
+    /// requires the lock, returns false if the refill list couldn't grow
+    static bool putBatch(Global& global, Batch batch) noexcept
+    {
+        try
+        {
+            global.refill.push_back(batch);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        global.refillBlocks += batch.count;
+        return true;
+    }
+
+    static void attach(Cache& cache)
+    {
+        Global& global = globalState();
+        {
+            std::lock_guard<std::mutex> lock(global.mutex);
+            cache.next = global.caches;
+            global.caches = &cache;
+            cache.state = Cache::attached;
+        }
+        // detaches the cache when the thread exits
+        static thread_local Detach guard{ cache };
+    }
+
+    static void detach(Cache& cache) noexcept
+    {
+        Global& global = globalState();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        for (Cache** link = &global.caches; *link; link = &(*link)->next)
+        {
+            if (*link == &cache)
+            {
+                *link = cache.next;
+                break;
+            }
+        }
+
+        // the list may be longer than a batch, but that doesn't matter for the refill list
+        const std::size_t freeBlocks = cache.freeBlocks.load(std::memory_order_relaxed);
+        if (freeBlocks)
+            putBatch(global, Batch{ cache.head, freeBlocks }); // lost if this fails
+        global.requestedBytes += cache.requestedBytes.load(std::memory_order_relaxed);
+
+        cache.head = nullptr;
+        cache.freeBlocks.store(0, std::memory_order_relaxed);
+        cache.requestedBytes.store(0, std::memory_order_relaxed);
+        cache.next = nullptr;
+        cache.state = Cache::detached;
+    }
+};
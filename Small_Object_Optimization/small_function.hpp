@@ -0,0 +1,196 @@
+/**
+ * @file    small_function.hpp
+ * @brief   move-only replacement for std::function with a configurable inline buffer
+ *
+ * The callable is managed by the storage functions of v6_function_ptr.hpp (with "void" as base
+ * type), so small callables live in the inline buffer and large ones on the heap, exactly like
+ * the objects of a SmallPtr. Calling doesn't go through the storage function: a second function
+ * pointer invokes the callable directly, so a call costs only one indirect jump.
+ *
+ * Unlike std::function, SmallFunction can hold move-only callables (e.g. lambdas capturing a
+ * std::unique_ptr), but can't be copied.
+ */
+
+#pragma once
+
+#include "v6_function_ptr.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+template <class Signature, size_t T_StackSize = 32>
+class SmallFunction;
+
+template <class R, class... Args, size_t T_StackSize>
+class SmallFunction<R(Args...), T_StackSize>
+{
+private:
+    static_assert(T_StackSize >= sizeof(void*), "must at least hold a pointer");
+    static constexpr std::size_t alignment = alignof(void*);
+
+    using Params = typename ParamTypes<void>::Param;
+    using StorageFunc = void (*)(Action, Params&);
+    using Invoker = R (*)(void*, Args&&...);
+
+    StorageFunc m_ptr;
+    Invoker m_invoke;
+    typename std::aligned_storage<T_StackSize, alignment>::type m_stack;
+
+    template <class F>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(F) <= T_StackSize && alignof(F) <= alignment &&
+               std::is_move_constructible<F>::value;
+    }
+
+    template <class F>
+    static R call(F& f, Args&&... args)
+    {
+        if constexpr (std::is_void<R>::value)
+            std::invoke(f, std::forward<Args>(args)...);
+        else
+            return std::invoke(f, std::forward<Args>(args)...);
+    }
+    template <class F>
+    static R invokeStack(void* stack, Args&&... args)
+    {
+        return call(*static_cast<F*>(stack), std::forward<Args>(args)...);
+    }
+    template <class F>
+    static R invokeHeap(void* stack, Args&&... args)
+    {
+        F* ptr;
+        memcpy(&ptr, stack, sizeof(ptr));
+        return call(*ptr, std::forward<Args>(args)...);
+    }
+
+    template <class F>
+    static bool isNull(const F& f) noexcept
+    {
+        if constexpr (std::is_pointer<F>::value || std::is_member_pointer<F>::value)
+            return f == nullptr;
+        else
+            return false;
+    }
+
+public:
+    SmallFunction() noexcept : m_ptr(nullptr), m_invoke(nullptr) {}
+    SmallFunction(std::nullptr_t) noexcept : SmallFunction() {}
+    ~SmallFunction() { reset(); }
+
+    /// implicit, like std::function
+    template <class F, class Fn = std::decay_t<F>,
+              class = std::enable_if_t<!std::is_same<Fn, SmallFunction>::value &&
+                                       std::is_invocable_r<R, Fn&, Args...>::value>>
+    SmallFunction(F&& f) : SmallFunction()
+    {
+        assign(std::forward<F>(f));
+    }
+
+    SmallFunction(SmallFunction&& rhs) /* noexcept */ : SmallFunction() { take(rhs); }
+    SmallFunction& operator=(SmallFunction&& rhs) /* noexcept */
+    {
+        if (this != &rhs)
+        {
+            reset();
+            take(rhs);
+        }
+        return *this;
+    }
+    SmallFunction& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+    template <class F, class Fn = std::decay_t<F>,
+              class = std::enable_if_t<!std::is_same<Fn, SmallFunction>::value &&
+                                       std::is_invocable_r<R, Fn&, Args...>::value>>
+    SmallFunction& operator=(F&& f)
+    {
+        reset();
+        assign(std::forward<F>(f));
+        return *this;
+    }
+
+    // disable copying
+    SmallFunction(const SmallFunction&) = delete;
+    SmallFunction& operator=(const SmallFunction&) = delete;
+
+    void reset() noexcept
+    {
+        if (m_ptr)
+        {
+            Params p;
+            p.destroy.stack = &m_stack;
+            m_ptr(Action::destroy, p);
+            m_ptr = nullptr;
+            m_invoke = nullptr;
+        }
+    }
+
+    /// calls the callable, throws std::bad_function_call if empty
+    R operator()(Args... args) const
+    {
+        if (!m_invoke)
+            throw std::bad_function_call();
+        // like std::function, a const SmallFunction may call a non-const callable
+        return m_invoke(const_cast<void*>(static_cast<const void*>(&m_stack)),
+                        std::forward<Args>(args)...);
+    }
+
+    // check functions
+    bool operator==(std::nullptr_t) const noexcept { return m_ptr == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return m_ptr != nullptr; }
+    explicit operator bool() const noexcept { return m_ptr != nullptr; }
+
+    bool usesHeap() const noexcept
+    {
+        if (!m_ptr)
+            return false;
+        Params p;
+        m_ptr(Action::uses_heap, p);
+        return p.usesHeap.value;
+    }
+    bool usesStack() const noexcept { return !usesHeap(); }
+
+private:
+    template <class F>
+    void assign(F&& f)
+    {
+        using Fn = std::decay_t<F>;
+        if (isNull(f))
+            return;
+
+        if constexpr (fitsInline<Fn>())
+        {
+            ::new (static_cast<void*>(&m_stack)) Fn(std::forward<F>(f));
+            m_ptr = StackStorage<Fn, void>::execute;
+            m_invoke = invokeStack<Fn>;
+        }
+        else
+        {
+            HeapStorage<Fn, void>::set(&m_stack, new Fn(std::forward<F>(f)));
+            m_ptr = HeapStorage<Fn, void>::execute;
+            m_invoke = invokeHeap<Fn>;
+        }
+    }
+
+    void take(SmallFunction& rhs) /* noexcept */
+    {
+        if (rhs.m_ptr)
+        {
+            Params p;
+            p.moveTo.stackFrom = &rhs.m_stack;
+            p.moveTo.stackTo = &m_stack;
+            rhs.m_ptr(Action::move_to, p);
+            m_ptr = rhs.m_ptr;
+            m_invoke = rhs.m_invoke;
+            // the source has been destroyed by move_to
+            rhs.m_ptr = nullptr;
+            rhs.m_invoke = nullptr;
+        }
+    }
+};
@@ -0,0 +1,249 @@
+/**
+ * @file    small_shared_ptr.hpp
+ * @brief   reference counted sibling of SmallPtr: counter and object share one pooled block
+ *
+ * Like std::make_shared, the reference count and the object are allocated together - but the
+ * block comes from a SlabPool instead of the heap. Objects that don't fit into the block are
+ * allocated separately, like in SmallPtr. The object is managed by the storage functions of
+ * v6_function_ptr.hpp.
+ *
+ * If the pointers are only used by one thread, @a T_ThreadSafe may be set to false: the counter
+ * is a plain integer then.
+ */
+
+#pragma once
+
+#include "slab_pool.hpp"
+#include "v6_function_ptr.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#if defined(__has_include)
+#if __has_include(<sys/single_threaded.h>)
+#include <sys/single_threaded.h>
+#define SMALLSHAREDPTR_HAS_SINGLE_THREADED 1
+#endif
+#endif
+
+/// with the default size, a block (count + storage function + buffer) is 64 bytes
+template <class T, size_t T_StackSize = 48, bool T_ThreadSafe = true>
+class SmallSharedPtr
+{
+private:
+    static_assert(!std::is_array<T>::value, "arrays not supported");
+    static constexpr std::size_t alignment = alignof(void*);
+
+    using Params = typename ParamTypes<T>::Param;
+    using StorageFunc = void (*)(Action, Params&);
+    using Count = std::conditional_t<T_ThreadSafe, std::atomic<long>, long>;
+
+    /// the pooled block: counter, storage function and the object (or a pointer to it)
+    struct Block
+    {
+        Count refs;
+        StorageFunc func;
+        typename std::aligned_storage<T_StackSize, alignment>::type stack;
+    };
+    using Pool = SlabPool<sizeof(Block), alignof(Block)>;
+
+    Block* m_block;
+
+    // tag dispatching
+    struct stack_tag
+    {
+    };
+    struct heap_tag
+    {
+    };
+
+    /// like std::shared_ptr in libstdc++: no atomic operations as long as there's only one thread
+    static bool singleThreaded() noexcept
+    {
+#ifdef SMALLSHAREDPTR_HAS_SINGLE_THREADED
+        return __libc_single_threaded;
+#else
+        return false;
+#endif
+    }
+
+    static void addRef(Block* block) noexcept
+    {
+        if constexpr (T_ThreadSafe)
+        {
+            if (singleThreaded())
+                block->refs.store(block->refs.load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+            else
+                block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            ++block->refs;
+        }
+    }
+    /// returns true if this was the last reference
+    static bool release(Block* block) noexcept
+    {
+        if constexpr (T_ThreadSafe)
+        {
+            if (singleThreaded())
+            {
+                const long refs = block->refs.load(std::memory_order_relaxed) - 1;
+                block->refs.store(refs, std::memory_order_relaxed);
+                return refs == 0;
+            }
+            return block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        else
+        {
+            return --block->refs == 0;
+        }
+    }
+
+    T* getPtr() const noexcept
+    {
+        if (m_block)
+        {
+            Params p;
+            p.getNonConst.stack = &m_block->stack;
+            m_block->func(Action::get_nonconst, p);
+            return p.getNonConst.ptr;
+        }
+        return nullptr;
+    }
+
+public:
+    SmallSharedPtr() noexcept : m_block(nullptr) {}
+    SmallSharedPtr(std::nullptr_t) noexcept : m_block(nullptr) {}
+    ~SmallSharedPtr() { reset(); }
+
+    template <class Derived, class... Args>
+    explicit SmallSharedPtr(InPlace<Derived>, Args&&... args) : m_block(nullptr)
+    {
+        emplace<Derived>(std::forward<Args>(args)...);
+    }
+
+    SmallSharedPtr(const SmallSharedPtr& rhs) noexcept : m_block(rhs.m_block)
+    {
+        if (m_block)
+            addRef(m_block);
+    }
+    SmallSharedPtr& operator=(const SmallSharedPtr& rhs) noexcept
+    {
+        SmallSharedPtr tmp(rhs);
+        swap(tmp);
+        return *this;
+    }
+    SmallSharedPtr(SmallSharedPtr&& rhs) noexcept : m_block(rhs.m_block) { rhs.m_block = nullptr; }
+    SmallSharedPtr& operator=(SmallSharedPtr&& rhs) noexcept
+    {
+        SmallSharedPtr tmp(std::move(rhs));
+        swap(tmp);
+        return *this;
+    }
+    SmallSharedPtr& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    void swap(SmallSharedPtr& rhs) noexcept { std::swap(m_block, rhs.m_block); }
+
+    void reset() noexcept
+    {
+        if (m_block)
+        {
+            if (release(m_block))
+            {
+                Params p;
+                p.destroy.stack = &m_block->stack;
+                m_block->func(Action::destroy, p);
+                m_block->~Block();
+                Pool::deallocate(m_block);
+            }
+            m_block = nullptr;
+        }
+    }
+
+    // access functions/operator
+    T* get() const noexcept { return getPtr(); }
+    T* operator->() const noexcept { return get(); }
+    T& operator*() const noexcept { return *get(); }
+
+    // check functions
+    bool operator==(std::nullptr_t) const noexcept { return m_block == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return m_block != nullptr; }
+    explicit operator bool() const noexcept { return m_block != nullptr; }
+
+    /// number of SmallSharedPtrs sharing the object (0 if empty)
+    long useCount() const noexcept
+    {
+        if (!m_block)
+            return 0;
+        if constexpr (T_ThreadSafe)
+            return m_block->refs.load(std::memory_order_relaxed);
+        else
+            return m_block->refs;
+    }
+
+    bool usesHeap() const noexcept
+    {
+        if (!m_block)
+            return false;
+        Params p;
+        m_block->func(Action::uses_heap, p);
+        return p.usesHeap.value;
+    }
+    bool usesStack() const noexcept { return !usesHeap(); }
+
+    template <class Derived, class... Args>
+    void emplace(Args&&... args)
+    {
+        static_assert(std::is_same<T, Derived>::value or std::is_base_of<T, Derived>::value,
+                      "may only use sub-classes of T!");
+        static_assert(std::is_constructible<Derived, Args...>::value, "cannot instantiate!");
+
+        reset();
+        // same rule as SmallPtr (the storage functions need to be able to move)
+        constexpr bool smallFit = (sizeof(Derived) <= T_StackSize) &&
+                                  (alignof(Derived) <= alignment) &&
+                                  std::is_move_constructible<Derived>::value;
+        Block* block = ::new (Pool::allocate()) Block{ { 1 }, nullptr, {} };
+        try
+        {
+            emplaceImpl<Derived>(*block, std::conditional_t<smallFit, stack_tag, heap_tag>{},
+                                 std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            block->~Block();
+            Pool::deallocate(block);
+            throw;
+        }
+        m_block = block;
+    }
+
+private:
+    template <class Derived, class... Args>
+    static void emplaceImpl(Block& block, stack_tag, Args&&... args)
+    {
+        ::new (static_cast<void*>(&block.stack)) Derived(std::forward<Args>(args)...);
+        block.func = StackStorage<Derived, T>::execute;
+    }
+    template <class Derived, class... Args>
+    static void emplaceImpl(Block& block, heap_tag, Args&&... args)
+    {
+        HeapStorage<Derived, T>::set(&block.stack, new Derived(std::forward<Args>(args)...));
+        block.func = HeapStorage<Derived, T>::execute;
+    }
+};
+
+template <class T, size_t N, bool T_ThreadSafe>
+void swap(SmallSharedPtr<T, N, T_ThreadSafe>& lhs,
+          SmallSharedPtr<T, N, T_ThreadSafe>& rhs) noexcept
+{
+    lhs.swap(rhs);
+}
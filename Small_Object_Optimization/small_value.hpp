@@ -0,0 +1,222 @@
+/**
+ * @file    small_value.hpp
+ * @brief   copyable sibling of SmallPtr: polymorphic value with small buffer optimization
+ *
+ * Copying is done by an additional "copy_to" action of the storage, so a copy of a small object
+ * stays in the stack buffer and only large objects have to be allocated.
+ */
+
+#pragma once
+
+#include "v6_function_ptr.hpp"
+
+#include <type_traits>
+#include <utility>
+
+template <class Derived, class Base>
+class ValueStackStorage : public StackStorage<Derived, Base>
+{
+public:
+    using Params = ParamTypes<Base>;
+    static void execute(Action action, typename Params::Param& param)
+    {
+        if (action == Action::copy_to)
+            copyTo(param.copyTo);
+        else
+            StackStorage<Derived, Base>::execute(action, param);
+    }
+
+    static void copyTo(typename Params::CopyTo& param)
+    {
+        const Derived* fromPtr = reinterpret_cast<const Derived*>(param.stackFrom);
+        ::new (param.stackTo) Derived(*fromPtr);
+    }
+};
+
+template <class Derived, class Base>
+class ValueHeapStorage : public HeapStorage<Derived, Base>
+{
+public:
+    using Params = ParamTypes<Base>;
+    static void execute(Action action, typename Params::Param& param)
+    {
+        if (action == Action::copy_to)
+            copyTo(param.copyTo);
+        else
+            HeapStorage<Derived, Base>::execute(action, param);
+    }
+
+    static void copyTo(typename Params::CopyTo& param)
+    {
+        const Derived* fromPtr;
+        memcpy(&fromPtr, param.stackFrom, sizeof(Base*));
+        HeapStorage<Derived, Base>::set(param.stackTo, new Derived(*fromPtr));
+    }
+};
+
+template <class T, size_t T_StackSize = 64>
+class SmallValue
+{
+private:
+    static_assert(!std::is_array<T>::value, "arrays not supported");
+    static constexpr std::size_t alignment = alignof(void*);
+
+    using Params = typename ParamTypes<T>::Param;
+    using StorageFunc = void (*)(Action, Params&);
+
+    StorageFunc m_ptr;
+    typename std::aligned_storage<T_StackSize, alignment>::type m_stack;
+
+    // tag dispatching
+    struct stack_tag
+    {
+    };
+    struct heap_tag
+    {
+    };
+
+    T* getPtr() const noexcept
+    {
+        if (m_ptr)
+        {
+            Params p;
+            p.getNonConst.stack = const_cast<void*>(static_cast<const void*>(&m_stack));
+            m_ptr(Action::get_nonconst, p);
+            return p.getNonConst.ptr;
+        }
+        return nullptr;
+    }
+
+public:
+    SmallValue() noexcept : m_ptr(nullptr) {}
+    ~SmallValue() { reset(); }
+
+    template <class Derived, class... Args>
+    explicit SmallValue(InPlace<Derived>, Args&&... args) : m_ptr(nullptr)
+    {
+        emplace<Derived>(std::forward<Args>(args)...);
+    }
+
+    SmallValue(const SmallValue& rhs) : m_ptr(nullptr) { copy(rhs); }
+    SmallValue& operator=(const SmallValue& rhs)
+    {
+        if (this != &rhs)
+        {
+            // copy first: if the copy throws, *this is unchanged - but moving it into place
+            // destroys the current value first, so if that move throws, *this is empty
+            SmallValue tmp(rhs);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    SmallValue(SmallValue&& rhs) /* noexcept */ : m_ptr(nullptr) { assign(rhs); }
+    SmallValue& operator=(SmallValue&& rhs) /* noexcept */
+    {
+        if (this != &rhs)
+        {
+            reset();
+            assign(rhs);
+        }
+        return *this;
+    }
+    SmallValue& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    void reset() noexcept
+    {
+        if (m_ptr)
+        {
+            Params p;
+            p.destroy.stack = &m_stack;
+            m_ptr(Action::destroy, p);
+            m_ptr = nullptr;
+        }
+    }
+
+    // access functions/operator
+    T* get() noexcept { return getPtr(); }
+    const T* get() const noexcept { return getPtr(); }
+
+    T* operator->() noexcept { return get(); }
+    const T* operator->() const noexcept { return get(); }
+
+    T& operator*() noexcept { return *get(); }
+    const T& operator*() const noexcept { return *get(); }
+
+    // check functions
+    bool operator==(std::nullptr_t) const noexcept { return get() == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return get() != nullptr; }
+    explicit operator bool() const noexcept { return *this != nullptr; }
+
+    bool usesHeap() const noexcept
+    {
+        if (!m_ptr)
+            return false;
+        Params p;
+        m_ptr(Action::uses_heap, p);
+        return p.usesHeap.value;
+    }
+    bool usesStack() const noexcept { return !usesHeap(); }
+
+    template <class Derived, class... Args>
+    void emplace(Args&&... args)
+    {
+        static_assert(std::is_same<T, Derived>::value or std::is_base_of<T, Derived>::value,
+                      "may only use sub-classes of T!");
+        static_assert(std::is_constructible<Derived, Args...>::value, "cannot instantiate!");
+        static_assert(std::is_copy_constructible<Derived>::value, "values must be copyable!");
+
+        reset();
+        constexpr bool smallFit =
+          (sizeof(Derived) <= T_StackSize) && (alignof(Derived) <= alignment);
+        emplaceImpl<Derived>(std::conditional_t < smallFit &&
+                               std::is_move_constructible<Derived>::value,
+                             stack_tag, heap_tag > {}, std::forward<Args>(args)...);
+    }
+
+private:
+    template <class Derived, class... Args>
+    void emplaceImpl(stack_tag, Args&&... args)
+    {
+        void* stack = &m_stack;
+        ::new (stack) Derived(std::forward<Args>(args)...);
+        m_ptr = ValueStackStorage<Derived, T>::execute;
+    }
+    template <class Derived, class... Args>
+    void emplaceImpl(heap_tag, Args&&... args)
+    {
+        Derived* ptr = new Derived(std::forward<Args>(args)...);
+        HeapStorage<Derived, T>::set(&m_stack, ptr);
+        m_ptr = ValueHeapStorage<Derived, T>::execute;
+    }
+
+    void copy(const SmallValue& rhs)
+    {
+        if (rhs.m_ptr)
+        {
+            Params p;
+            p.copyTo.stackFrom = &rhs.m_stack;
+            p.copyTo.stackTo = &m_stack;
+            rhs.m_ptr(Action::copy_to, p);
+            m_ptr = rhs.m_ptr;
+        }
+    }
+
+    void assign(SmallValue& rhs) /* noexcept */
+    {
+        if (rhs.m_ptr)
+        {
+            Params p;
+            p.moveTo.stackFrom = &rhs.m_stack;
+            p.moveTo.stackTo = &m_stack;
+            rhs.m_ptr(Action::move_to, p);
+            m_ptr = rhs.m_ptr;
+            // the source has been destroyed by move_to
+            rhs.m_ptr = nullptr;
+        }
+    }
+};
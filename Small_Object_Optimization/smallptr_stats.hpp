@@ -0,0 +1,149 @@
+/**
+ * @file    smallptr_stats.hpp
+ * @brief   optional statistics on how often SmallPtr has to fall back to the heap
+ *
+ * Only used if SMALLPTR_ENABLE_STATS is defined before including v6_function_ptr.hpp, otherwise
+ * SmallPtr doesn't pay anything for it.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+/// counters for one type that has been emplace()d into a SmallPtr
+struct SmallPtrTypeStats
+{
+    SmallPtrTypeStats(std::string name, std::size_t size) : typeName(std::move(name)), typeSize(size)
+    {
+    }
+
+    const std::string typeName;
+    const std::size_t typeSize;
+
+    std::atomic<std::size_t> stackHits{ 0 };
+    std::atomic<std::size_t> heapFallbacks{ 0 };
+    std::atomic<std::size_t> heapBytes{ 0 };
+};
+
+/// global registry of all per-type counters
+class SmallPtrStats
+{
+public:
+    static SmallPtrStats& instance()
+    {
+        static SmallPtrStats stats;
+        return stats;
+    }
+
+    /// counters of the given type (registered on first use)
+    template <class Derived>
+    static SmallPtrTypeStats& forType()
+    {
+        static SmallPtrTypeStats& stats =
+          instance().registerType(demangle(typeid(Derived).name()), sizeof(Derived));
+        return stats;
+    }
+
+    // The first call registers the type, which allocates. If that fails, the call just isn't
+    // counted: the statistics must not make emplace() throw after the object is in place.
+    template <class Derived>
+    static void recordStack() noexcept
+    {
+        try
+        {
+            forType<Derived>().stackHits.fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (...)
+        {
+        }
+    }
+    /// @a bytes is the size of the allocated block (the object together with its allocator)
+    template <class Derived>
+    static void recordHeap(std::size_t bytes) noexcept
+    {
+        try
+        {
+            SmallPtrTypeStats& stats = forType<Derived>();
+            stats.heapFallbacks.fetch_add(1, std::memory_order_relaxed);
+            stats.heapBytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /// prints a table with all counters
+    void dump(std::ostream& os) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        os << std::left << std::setw(40) << "type" << std::right << std::setw(8) << "sizeof"
+           << std::setw(12) << "stack" << std::setw(12) << "heap" << std::setw(14) << "heap bytes"
+           << '\n';
+        for (const SmallPtrTypeStats& stats : m_types)
+        {
+            os << std::left << std::setw(40) << stats.typeName << std::right << std::setw(8)
+               << stats.typeSize << std::setw(12) << stats.stackHits.load() << std::setw(12)
+               << stats.heapFallbacks.load() << std::setw(14) << stats.heapBytes.load() << '\n';
+        }
+    }
+
+    /// sets all counters back to 0 (the types stay registered)
+    void reset() noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (SmallPtrTypeStats& stats : m_types)
+        {
+            stats.stackHits = 0;
+            stats.heapFallbacks = 0;
+            stats.heapBytes = 0;
+        }
+    }
+
+    /// print the table to std::cerr when the program exits
+    void dumpAtExit(bool enable) noexcept { m_dumpAtExit = enable; }
+
+    ~SmallPtrStats()
+    {
+        if (m_dumpAtExit)
+            dump(std::cerr);
+    }
+
+private:
+    SmallPtrStats() = default;
+
+    SmallPtrTypeStats& registerType(std::string name, std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // deque: references stay valid when adding more types
+        m_types.emplace_back(std::move(name), size);
+        return m_types.back();
+    }
+
+    static std::string demangle(const char* name)
+    {
+#if defined(__GNUG__)
+        int status = 0;
+        std::unique_ptr<char, void (*)(void*)> demangled(
+          abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+        if (status == 0 && demangled)
+            return demangled.get();
+#endif
+        return name;
+    }
+
+    mutable std::mutex m_mutex;
+    std::deque<SmallPtrTypeStats> m_types;
+    std::atomic<bool> m_dumpAtExit{ false };
+};
@@ -0,0 +1,133 @@
+/**
+ * @file    stack_size.hpp
+ * @brief   compile-time helpers to choose the stack size of a SmallPtr for a set of types
+ *
+ * Example:
+ *   using Pets = StackSizeReport<TypeList<Cat, Dog, Parrot, Elephant>>;
+ *   using PetPtr = SmallPtr<IPet, Pets::stackSizeFor(50)>;
+ *   static_assert(std::is_same<Pets::Spilled<Pets::stackSizeFor(50)>,
+ *                              TypeList<Parrot, Elephant>>::value, "");
+ *
+ * For a SmallPtr with a larger buffer alignment, pass the same alignment to the report:
+ *   using Counters = StackSizeReport<TypeList<CoreCounter, Cat>, 64>;
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+/// just a list of types
+template <class... Types>
+struct TypeList
+{
+};
+
+/// concatenation of type lists
+template <class... Lists>
+struct Concat;
+template <>
+struct Concat<>
+{
+    using type = TypeList<>;
+};
+template <class... A>
+struct Concat<TypeList<A...>>
+{
+    using type = TypeList<A...>;
+};
+template <class... A, class... B, class... Rest>
+struct Concat<TypeList<A...>, TypeList<B...>, Rest...>
+{
+    using type = typename Concat<TypeList<A..., B...>, Rest...>::type;
+};
+
+/**
+ * Same decision as SmallPtr::fitsInline(): does @a T go into a stack buffer of @a T_StackSize
+ * bytes, aligned to @a T_Alignment?
+ */
+template <class T, std::size_t T_StackSize, std::size_t T_Alignment = alignof(void*)>
+struct FitsOnStack
+  : std::integral_constant<bool, (sizeof(T) <= T_StackSize) && (alignof(T) <= T_Alignment) &&
+                                   std::is_move_constructible<T>::value>
+{
+};
+
+/// @a T_Alignment is the alignment of the SmallPtr's stack buffer
+template <class List, std::size_t T_Alignment = alignof(void*)>
+struct StackSizeReport;
+
+template <class... Types, std::size_t T_Alignment>
+struct StackSizeReport<TypeList<Types...>, T_Alignment>
+{
+    static constexpr std::size_t count = sizeof...(Types);
+    static_assert(count > 0, "empty type list");
+
+    /// sizeof() of each type
+    static constexpr std::array<std::size_t, count> sizes = { { sizeof(Types)... } };
+    /// types that can't be moved (or are over-aligned for the buffer) always go on the heap
+    static constexpr std::array<bool, count> movable = { {
+      (std::is_move_constructible<Types>::value && alignof(Types) <= T_Alignment)... } };
+
+    /// whether each type goes on the heap for the given stack size
+    static constexpr std::array<bool, count> onHeap(std::size_t stackSize)
+    {
+        std::array<bool, count> result{};
+        for (std::size_t i = 0; i < count; ++i)
+            result[i] = !movable[i] || sizes[i] > stackSize;
+        return result;
+    }
+
+    /// number of types that go on the heap for the given stack size
+    static constexpr std::size_t numSpilled(std::size_t stackSize)
+    {
+        std::size_t num = 0;
+        for (bool heap : onHeap(stackSize))
+            num += heap ? 1 : 0;
+        return num;
+    }
+
+    /**
+     * The smallest stack size (rounded up to pointer size) at which at least @a percent percent
+     * of the types fit into the stack buffer. If that's impossible because too many types can't
+     * be moved (or are over-aligned), the size that fits all other types is returned.
+     */
+    static constexpr std::size_t stackSizeFor(unsigned percent)
+    {
+        // sizes of the movable types, sorted
+        std::array<std::size_t, count> sorted{};
+        std::size_t numMovable = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (!movable[i])
+                continue;
+            std::size_t pos = numMovable++;
+            for (; pos > 0 && sorted[pos - 1] > sizes[i]; --pos)
+                sorted[pos] = sorted[pos - 1];
+            sorted[pos] = sizes[i];
+        }
+
+        std::size_t required = (percent * count + 99) / 100;
+        if (required > numMovable)
+            required = numMovable;
+
+        std::size_t size = required ? sorted[required - 1] : 0;
+        // the stack must be able to hold a pointer to heap objects
+        if (size < sizeof(void*))
+            size = sizeof(void*);
+        return (size + alignof(void*) - 1) / alignof(void*) * alignof(void*);
+    }
+
+    /// all types that go on the heap for the given stack size
+    template <std::size_t T_StackSize>
+    using Spilled = typename Concat<
+      std::conditional_t<FitsOnStack<Types, T_StackSize, T_Alignment>::value, TypeList<>,
+                         TypeList<Types>>...>::type;
+
+    /// all types that go into the stack buffer for the given stack size
+    template <std::size_t T_StackSize>
+    using Inline = typename Concat<
+      std::conditional_t<FitsOnStack<Types, T_StackSize, T_Alignment>::value, TypeList<Types>,
+                         TypeList<>>...>::type;
+};
@@ -5,17 +5,86 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 #include "pets.hpp"
+#include "stack_size.hpp"
 
 //#include "v1_unique_ptr.hpp"
 //#include "v2_with_stubs.hpp"
 //#include "v3_type_erased.hpp"
 //#include "v4_small_opt1.hpp"
 //#include "v5_small_opt2.hpp"
+#ifdef TEST_V7
+#include "v7_inline_vtable.hpp"
+#else
 #include "v6_function_ptr.hpp"
+#include "batch_dispatch.hpp"
+#include "mpsc_queue.hpp"
+#include "poly_vector.hpp"
+#include "slab_allocator.hpp"
+#include "small_function.hpp"
+#include "small_shared_ptr.hpp"
+#include "small_value.hpp"
+#define TEST_ALLOCATOR
+#define TEST_SMALL_VALUE
+#define TEST_POLY_VECTOR
+#define TEST_BATCH_DISPATCH
+#define TEST_RELOCATION
+#define TEST_MPSC_QUEUE
+#define TEST_SMALL_FUNCTION
+#define TEST_EMPLACE_STRONG
+#define TEST_SMALL_SHARED_PTR
+#define TEST_SLAB_ALLOCATOR
+#define TEST_ALIGNMENT
+#if SMALLPTR_HAS_CONSTEXPR
+#define TEST_CONSTEXPR
+#endif
+#endif
 
 #define TEST_MOVING
 
+/// a pet whose move constructor throws on request
+class ClumsyPet : public IPet
+{
+public:
+    /// number of moves that succeed before the failing ones
+    static int s_movesBeforeFailure;
+    /// number of moves that throw
+    static int s_failingMoves;
+    /// number of existing instances
+    static int s_instances;
+
+    // not noexcept: emplaceStrong() constructs it in the scratch buffer
+    ClumsyPet() { ++s_instances; }
+    ClumsyPet(ClumsyPet&&)
+    {
+        if (s_movesBeforeFailure > 0)
+            --s_movesBeforeFailure;
+        else if (s_failingMoves > 0)
+        {
+            --s_failingMoves;
+            throw std::runtime_error("dropped");
+        }
+        ++s_instances;
+    }
+    ~ClumsyPet() override { --s_instances; }
+
+    std::string makeSomeNoise() final { return "Oops!"; }
+};
+int ClumsyPet::s_movesBeforeFailure = 0;
+int ClumsyPet::s_failingMoves = 0;
+int ClumsyPet::s_instances = 0;
+
 // test various constructors
 TEST(SmallPtr, Construct)
 {
@@ -227,3 +296,1176 @@ TEST(SmallPtr, Swap)
     EXPECT_EQ(cat.get(), nullptr);
     EXPECT_EQ(dog->makeSomeNoise(), "Charly!");
 }
+
+// containers of SmallPtrs can be sorted and rotated
+TEST(SmallPtr, Sort)
+{
+    std::vector<SmallPtr<IPet>> pets;
+    for (int i = 0; i < 20; ++i)
+    {
+        pets.emplace_back(InPlace<Cat>{});
+        pets.emplace_back(InPlace<Dog>{}, "Bob");
+        pets.emplace_back(InPlace<Parrot>{}, "Polly");
+    }
+    auto byNoise = [](SmallPtr<IPet>& lhs, SmallPtr<IPet>& rhs) {
+        return lhs->makeSomeNoise() < rhs->makeSomeNoise();
+    };
+    std::sort(pets.begin(), pets.end(), byNoise);
+    EXPECT_TRUE(std::is_sorted(pets.begin(), pets.end(), byNoise));
+    EXPECT_EQ(pets.front()->makeSomeNoise(), "Meow!");
+    EXPECT_EQ(pets.back()->makeSomeNoise(), "Woof, woof!");
+
+    std::rotate(pets.begin(), pets.begin() + 25, pets.end());
+    EXPECT_EQ(pets.front()->makeSomeNoise(), "Polly!");
+    EXPECT_EQ(pets.back()->makeSomeNoise(), "Polly!");
+    EXPECT_EQ(pets[35]->makeSomeNoise(), "Meow!");
+}
+
+#ifdef TEST_ALLOCATOR
+/// memory resource that counts what passes through it
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t allocations = 0;
+    size_t deallocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        ++deallocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+TEST(SmallPtr, Allocator)
+{
+    using PmrPtr = SmallPtr<IPet, 64, std::pmr::polymorphic_allocator<IPet>>;
+    CountingResource resource;
+    {
+        // small objects don't need the allocator
+        PmrPtr pet(std::allocator_arg, &resource, InPlace<Dog>{});
+        EXPECT_TRUE(pet.usesStack());
+        EXPECT_EQ(resource.allocations, 0u);
+
+        pet.emplace<Parrot>("Polly");
+        EXPECT_TRUE(pet.usesHeap());
+        EXPECT_EQ(pet->makeSomeNoise(), "Polly!");
+        EXPECT_EQ(resource.allocations, 1u);
+
+        // moving passes the pointer, the memory still belongs to the resource
+        PmrPtr thief(std::move(pet));
+        EXPECT_EQ(thief.get_allocator().resource(), &resource);
+        EXPECT_EQ(thief->makeSomeNoise(), "Polly!");
+
+        // the target of an assignment keeps its own allocator
+        PmrPtr other;
+        other = std::move(thief);
+        EXPECT_NE(other.get_allocator().resource(), &resource);
+        EXPECT_EQ(resource.deallocations, 0u);
+
+        other.emplace<Elephant>(1, 2.0);
+        EXPECT_EQ(resource.deallocations, 1u);
+        EXPECT_EQ(resource.allocations, 1u);
+    }
+    EXPECT_EQ(resource.allocations, resource.deallocations);
+}
+#endif
+
+TEST(StackSize, Report)
+{
+    using Pets = StackSizeReport<TypeList<Cat, Dog, Parrot, Elephant>>;
+    static_assert(Pets::count == 4, "");
+
+    // elephants can't be moved -> they never fit
+    static_assert(Pets::stackSizeFor(100) == sizeof(Parrot), "");
+    static_assert(Pets::numSpilled(Pets::stackSizeFor(100)) == 1, "");
+
+    constexpr size_t halfSize = Pets::stackSizeFor(50);
+    static_assert(halfSize == sizeof(Dog), "");
+    static_assert(std::is_same<Pets::Spilled<halfSize>, TypeList<Parrot, Elephant>>::value, "");
+    static_assert(std::is_same<Pets::Inline<halfSize>, TypeList<Cat, Dog>>::value, "");
+    static_assert(Pets::numSpilled(halfSize) == 2, "");
+
+    constexpr auto onHeap = Pets::onHeap(Pets::stackSizeFor(25));
+    static_assert(!onHeap[0] && onHeap[1] && onHeap[2] && onHeap[3], "");
+
+    // ... and the result can be used for the pointer
+    SmallPtr<IPet, halfSize> dog(InPlace<Dog>{});
+    EXPECT_TRUE(dog.usesStack());
+    SmallPtr<IPet, halfSize> parrot(InPlace<Parrot>{}, "Rio");
+    EXPECT_TRUE(parrot.usesHeap());
+}
+
+#ifdef TEST_SMALL_VALUE
+TEST(SmallValue, Copy)
+{
+    // small object -> the copy lives in its own stack buffer
+    SmallValue<IPet> dog(InPlace<Dog>{}, "Bello");
+    SmallValue<IPet> dog2(dog);
+    ASSERT_TRUE(dog);
+    ASSERT_TRUE(dog2);
+    EXPECT_TRUE(dog2.usesStack());
+    EXPECT_NE(dog.get(), dog2.get());
+    EXPECT_EQ(dog2->makeSomeNoise(), "Woof, woof!");
+
+    // large object -> a new heap object
+    SmallValue<IPet> parrot(InPlace<Parrot>{}, "Gustav");
+    SmallValue<IPet> parrot2(parrot);
+    EXPECT_TRUE(parrot2.usesHeap());
+    EXPECT_NE(parrot.get(), parrot2.get());
+    EXPECT_EQ(parrot->makeSomeNoise(), "Gustav!");
+    EXPECT_EQ(parrot2->makeSomeNoise(), "Gustav!");
+
+    // copy assignment replaces the old value
+    dog2 = parrot;
+    EXPECT_TRUE(dog2.usesHeap());
+    EXPECT_EQ(dog2->makeSomeNoise(), "Gustav!");
+    EXPECT_NE(dog2.get(), parrot.get());
+    parrot2 = dog;
+    EXPECT_TRUE(parrot2.usesStack());
+    EXPECT_EQ(parrot2->makeSomeNoise(), "Woof, woof!");
+
+    // copying "nothing"
+    SmallValue<IPet> empty;
+    dog2 = empty;
+    EXPECT_FALSE(dog2);
+    SmallValue<IPet> empty2(empty);
+    EXPECT_FALSE(empty2);
+}
+
+TEST(SmallValue, Move)
+{
+    SmallValue<IPet> cat(InPlace<Cat>{});
+    SmallValue<IPet> thief(std::move(cat));
+    ASSERT_FALSE(cat);
+    EXPECT_EQ(thief->makeSomeNoise(), "Meow!");
+
+    SmallValue<IPet> parrot(InPlace<Parrot>{}, "Ara");
+    const IPet* ptr = parrot.get();
+    thief = std::move(parrot);
+    ASSERT_FALSE(parrot);
+    EXPECT_EQ(thief.get(), ptr);
+    EXPECT_EQ(thief->makeSomeNoise(), "Ara!");
+}
+
+TEST(SmallValue, Vector)
+{
+    std::vector<SmallValue<IPet>> pets;
+    pets.emplace_back(InPlace<Cat>{});
+    pets.emplace_back(InPlace<Dog>{});
+    pets.emplace_back(InPlace<Parrot>{}, "Loriot");
+
+    // snapshot
+    std::vector<SmallValue<IPet>> copy = pets;
+    ASSERT_EQ(copy.size(), 3u);
+    EXPECT_EQ(copy[0]->makeSomeNoise(), "Meow!");
+    EXPECT_EQ(copy[1]->makeSomeNoise(), "Woof, woof!");
+    EXPECT_EQ(copy[2]->makeSomeNoise(), "Loriot!");
+    for (size_t i = 0; i < pets.size(); ++i)
+        EXPECT_NE(copy[i].get(), pets[i].get());
+}
+#endif
+
+#ifdef TEST_POLY_VECTOR
+TEST(PolyVector, EmplaceBack)
+{
+    PolyVector<IPet> pets;
+    EXPECT_TRUE(pets.empty());
+
+    pets.emplace_back<Cat>();
+    pets.emplace_back<Dog>("Lassie");
+    pets.emplace_back<Parrot>("Polly");
+    pets.emplace_back<Elephant>(300, 5000.0);
+    ASSERT_EQ(pets.size(), 4u);
+
+    EXPECT_EQ(pets[0].makeSomeNoise(), "Meow!");
+    EXPECT_EQ(pets[1].makeSomeNoise(), "Woof, woof!");
+    EXPECT_EQ(pets[2].makeSomeNoise(), "Polly!");
+    EXPECT_EQ(pets[3].makeSomeNoise(), "Toooooooooot!");
+
+    // only the large and the non-movable pet live on the heap
+    EXPECT_FALSE(pets.usesHeap(0));
+    EXPECT_FALSE(pets.usesHeap(1));
+    EXPECT_TRUE(pets.usesHeap(2));
+    EXPECT_TRUE(pets.usesHeap(3));
+
+    // packed: no element takes more than it needs
+    EXPECT_LE(pets.bytesUsed(), sizeof(Cat) + sizeof(Dog) + 2 * sizeof(void*) + 3 * 16);
+
+    std::vector<std::string> noises;
+    for (IPet& pet : pets)
+        noises.push_back(pet.makeSomeNoise());
+    EXPECT_EQ(noises, (std::vector<std::string>{ "Meow!", "Woof, woof!", "Polly!",
+                                                 "Toooooooooot!" }));
+}
+
+TEST(PolyVector, Growth)
+{
+    PolyVector<IPet> pets;
+    std::vector<const IPet*> heapPets;
+    for (int i = 0; i < 1000; ++i)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            pets.emplace_back<Cat>();
+            break;
+        case 1:
+            pets.emplace_back<Dog>("Rex");
+            break;
+        default:
+            heapPets.push_back(&pets.emplace_back<Parrot>("Coco"));
+            break;
+        }
+    }
+    ASSERT_EQ(pets.size(), 1000u);
+    EXPECT_GE(pets.bytesCapacity(), pets.bytesUsed());
+
+    size_t heapIndex = 0;
+    for (size_t i = 0; i < pets.size(); ++i)
+    {
+        const char* expected = (i % 3 == 0) ? "Meow!" : (i % 3 == 1) ? "Woof, woof!" : "Coco!";
+        EXPECT_EQ(pets[i].makeSomeNoise(), expected);
+        // heap objects don't move when the buffer grows
+        if (i % 3 == 2)
+        {
+            EXPECT_EQ(&pets[i], heapPets[heapIndex++]);
+        }
+    }
+}
+
+TEST(PolyVector, Erase)
+{
+    PolyVector<IPet> pets;
+    pets.emplace_back<Dog>("Snoopy");
+    pets.emplace_back<Cat>();
+    pets.emplace_back<Parrot>("Hansi");
+    pets.emplace_back<Dog>("Pluto");
+    pets.emplace_back<Cat>();
+    const size_t used = pets.bytesUsed();
+
+    auto it = pets.erase(pets.begin());
+    ASSERT_EQ(pets.size(), 4u);
+    EXPECT_EQ(it->makeSomeNoise(), "Meow!");
+    EXPECT_LT(pets.bytesUsed(), used);
+
+    it = pets.erase(it + 1);
+    ASSERT_EQ(pets.size(), 3u);
+    EXPECT_EQ(it->makeSomeNoise(), "Woof, woof!");
+    EXPECT_EQ(pets[0].makeSomeNoise(), "Meow!");
+    EXPECT_EQ(pets[2].makeSomeNoise(), "Meow!");
+
+    pets.pop_back();
+    it = pets.erase(pets.end() - 1);
+    EXPECT_EQ(it, pets.end());
+    ASSERT_EQ(pets.size(), 1u);
+    EXPECT_EQ(pets[0].makeSomeNoise(), "Meow!");
+
+    pets.clear();
+    EXPECT_TRUE(pets.empty());
+    EXPECT_EQ(pets.bytesUsed(), 0u);
+
+    // moving the container moves the buffer
+    pets.emplace_back<Dog>();
+    PolyVector<IPet> other(std::move(pets));
+    EXPECT_TRUE(pets.empty());
+    ASSERT_EQ(other.size(), 1u);
+    EXPECT_EQ(other[0].makeSomeNoise(), "Woof, woof!");
+}
+
+TEST(PolyVector, MoveFails)
+{
+    ClumsyPet::s_instances = 0;
+    {
+        PolyVector<IPet> pets;
+        pets.emplace_back<Cat>();
+        for (int i = 0; i < 3; ++i)
+            pets.emplace_back<ClumsyPet>();
+        const size_t capacity = pets.bytesCapacity();
+
+        // growing fails at the second clumsy pet -> the first one is moved back
+        ClumsyPet::s_movesBeforeFailure = 1;
+        ClumsyPet::s_failingMoves = 1;
+        EXPECT_THROW(pets.reserve(0, 2 * capacity), std::runtime_error);
+        EXPECT_EQ(pets.bytesCapacity(), capacity);
+        ASSERT_EQ(pets.size(), 4u);
+        EXPECT_EQ(ClumsyPet::s_instances, 3);
+        for (size_t i = 1; i < pets.size(); ++i)
+            EXPECT_EQ(pets[i].makeSomeNoise(), "Oops!");
+
+        // ... and if that fails, too, it's lost (but not destroyed twice)
+        ClumsyPet::s_movesBeforeFailure = 1;
+        ClumsyPet::s_failingMoves = 2;
+        EXPECT_THROW(pets.reserve(0, 2 * capacity), std::runtime_error);
+        ASSERT_EQ(pets.size(), 3u);
+        EXPECT_EQ(ClumsyPet::s_instances, 2);
+
+        // closing the gap fails: the cat is gone nevertheless
+        ClumsyPet::s_failingMoves = 1;
+        EXPECT_THROW(pets.erase(pets.begin()), std::runtime_error);
+        ASSERT_EQ(pets.size(), 2u);
+        EXPECT_EQ(pets[0].makeSomeNoise(), "Oops!");
+        EXPECT_EQ(pets[1].makeSomeNoise(), "Oops!");
+        EXPECT_EQ(ClumsyPet::s_instances, 2);
+
+        pets.erase(pets.begin());
+        EXPECT_EQ(pets.size(), 1u);
+        EXPECT_EQ(ClumsyPet::s_instances, 1);
+    }
+    EXPECT_EQ(ClumsyPet::s_instances, 0);
+}
+#endif
+
+#ifdef TEST_BATCH_DISPATCH
+/// counts how the pets were passed to it
+struct CountingVisitor
+{
+    size_t cats = 0;
+    size_t dogs = 0;
+    size_t others = 0;
+    std::vector<std::string> noises;
+
+    void operator()(Cat& cat)
+    {
+        ++cats;
+        noises.push_back(cat.makeSomeNoise());
+    }
+    void operator()(Dog& dog)
+    {
+        ++dogs;
+        noises.push_back(dog.makeSomeNoise());
+    }
+    void operator()(IPet& pet)
+    {
+        ++others;
+        noises.push_back(pet.makeSomeNoise());
+    }
+};
+
+TEST(BatchDispatch, Groups)
+{
+    std::vector<SmallPtr<IPet>> pets;
+    pets.emplace_back(InPlace<Dog>{});
+    pets.emplace_back(InPlace<Cat>{});
+    pets.emplace_back(InPlace<Parrot>{}, "Pippin");
+    pets.emplace_back(InPlace<Dog>{}, "Rex");
+    pets.emplace_back();
+    pets.emplace_back(InPlace<Cat>{});
+    pets.emplace_back(InPlace<Elephant>{}, 1, 2.0);
+
+    BatchDispatcher<SmallPtr<IPet>, Cat, Dog> dispatcher(pets);
+    EXPECT_EQ(dispatcher.groupSize(0), 2u);
+    EXPECT_EQ(dispatcher.groupSize(1), 2u);
+    EXPECT_EQ(dispatcher.groupSize(2), 2u);
+
+    CountingVisitor visitor;
+    dispatcher.visit(visitor);
+    EXPECT_EQ(visitor.cats, 2u);
+    EXPECT_EQ(visitor.dogs, 2u);
+    EXPECT_EQ(visitor.others, 2u);
+    // group by group, in the order of the types
+    EXPECT_EQ(visitor.noises, (std::vector<std::string>{ "Meow!", "Meow!", "Woof, woof!",
+                                                         "Woof, woof!", "Pippin!",
+                                                         "Toooooooooot!" }));
+
+    // heap types can be grouped as well
+    size_t parrots = 0;
+    batchVisit<Parrot>(pets, [&](auto& pet) {
+        if (std::is_same<std::decay_t<decltype(pet)>, Parrot>::value)
+            ++parrots;
+    });
+    EXPECT_EQ(parrots, 1u);
+}
+#endif
+
+#ifdef TEST_RELOCATION
+/// a pet that counts its move constructions and destructions
+template <bool T_Relocatable>
+class CountingPet : public IPet
+{
+public:
+    static int moves;
+    static int destructions;
+
+    CountingPet() = default;
+    CountingPet(CountingPet&&) noexcept { ++moves; }
+    ~CountingPet() override { ++destructions; }
+
+    std::string makeSomeNoise() final { return "Tick!"; }
+};
+template <bool T_Relocatable>
+int CountingPet<T_Relocatable>::moves = 0;
+template <bool T_Relocatable>
+int CountingPet<T_Relocatable>::destructions = 0;
+
+template <>
+struct IsTriviallyRelocatable<CountingPet<true>> : std::true_type
+{
+};
+
+TEST(SmallPtr, TriviallyRelocatable)
+{
+    static_assert(IsTriviallyRelocatable<Cat>::value, "cats are relocatable");
+    static_assert(!IsTriviallyRelocatable<Dog>::value, "dogs contain a std::string");
+
+    using Relocatable = CountingPet<true>;
+    {
+        SmallPtr<IPet> pet(InPlace<Relocatable>{});
+        SmallPtr<IPet> thief(std::move(pet));
+        pet = std::move(thief);
+        EXPECT_EQ(pet->makeSomeNoise(), "Tick!");
+        EXPECT_TRUE(pet.usesStack());
+
+        // no constructor/destructor calls for moving
+        EXPECT_EQ(Relocatable::moves, 0);
+        EXPECT_EQ(Relocatable::destructions, 0);
+    }
+    EXPECT_EQ(Relocatable::destructions, 1);
+
+    using NotRelocatable = CountingPet<false>;
+    {
+        SmallPtr<IPet> pet(InPlace<NotRelocatable>{});
+        SmallPtr<IPet> thief(std::move(pet));
+        pet = std::move(thief);
+        EXPECT_EQ(NotRelocatable::moves, 2);
+        EXPECT_EQ(NotRelocatable::destructions, 2);
+    }
+    EXPECT_EQ(NotRelocatable::destructions, 3);
+}
+
+TEST(SmallPtr, SwapRelocates)
+{
+    using Relocatable = CountingPet<true>;
+    Relocatable::moves = 0;
+    Relocatable::destructions = 0;
+    {
+        SmallPtr<IPet> first(InPlace<Relocatable>{});
+        SmallPtr<IPet> second(InPlace<Relocatable>{});
+        SmallPtr<IPet> empty;
+        SmallPtr<IPet> parrot(InPlace<Parrot>{}, "Polly");
+        const IPet* parrotPtr = parrot.get();
+
+        first.swap(second);
+        swap(first, empty);
+        swap(second, parrot);
+        EXPECT_FALSE(first);
+        EXPECT_EQ(empty->makeSomeNoise(), "Tick!");
+        EXPECT_EQ(parrot->makeSomeNoise(), "Tick!");
+        // the heap object itself isn't moved
+        EXPECT_EQ(second.get(), parrotPtr);
+
+        // only memcpy, no constructor/destructor calls
+        EXPECT_EQ(Relocatable::moves, 0);
+        EXPECT_EQ(Relocatable::destructions, 0);
+
+        // self-swap keeps the object
+        parrot.swap(parrot);
+        EXPECT_EQ(parrot->makeSomeNoise(), "Tick!");
+    }
+    EXPECT_EQ(Relocatable::destructions, 2);
+
+    using NotRelocatable = CountingPet<false>;
+    NotRelocatable::moves = 0;
+    NotRelocatable::destructions = 0;
+    {
+        SmallPtr<IPet> first(InPlace<NotRelocatable>{});
+        SmallPtr<IPet> cat(InPlace<Cat>{});
+        swap(first, cat);
+        // the cat is relocatable, so the other pet is moved only once
+        EXPECT_EQ(NotRelocatable::moves, 1);
+        EXPECT_EQ(NotRelocatable::destructions, 1);
+        EXPECT_EQ(first->makeSomeNoise(), "Meow!");
+
+        // both not relocatable -> via a temporary buffer
+        SmallPtr<IPet> second(InPlace<NotRelocatable>{});
+        swap(cat, second);
+        EXPECT_EQ(NotRelocatable::moves, 4);
+        EXPECT_EQ(NotRelocatable::destructions, 4);
+    }
+    EXPECT_EQ(NotRelocatable::destructions, 6);
+}
+
+TEST(SmallPtr, MoveAssignReplaces)
+{
+    using Pet = CountingPet<false>;
+    Pet::destructions = 0;
+    SmallPtr<IPet> pet(InPlace<Pet>{});
+    SmallPtr<IPet> cat(InPlace<Cat>{});
+    // the old pet is destroyed, not leaked
+    pet = std::move(cat);
+    EXPECT_EQ(Pet::destructions, 1);
+    EXPECT_EQ(pet->makeSomeNoise(), "Meow!");
+    EXPECT_FALSE(cat);
+
+    // self-assignment keeps the object
+    SmallPtr<IPet>& self = pet;
+    pet = std::move(self);
+    ASSERT_TRUE(pet);
+    EXPECT_EQ(pet->makeSomeNoise(), "Meow!");
+}
+#endif
+
+#ifdef TEST_MPSC_QUEUE
+TEST(MpscQueue, SingleThread)
+{
+    MpscQueue<IPet, 4> queue;
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(queue.tryEmplace<Cat>());
+    EXPECT_TRUE(queue.tryEmplace<Dog>("Rex"));
+    EXPECT_TRUE(queue.tryEmplace<Parrot>("Polly"));
+    EXPECT_TRUE(queue.tryEmplace<Cat>());
+    // full
+    EXPECT_FALSE(queue.tryEmplace<Cat>());
+    EXPECT_FALSE(queue.empty());
+
+    std::vector<std::string> noise;
+    auto handler = [&noise](IPet& pet) { noise.push_back(pet.makeSomeNoise()); };
+    EXPECT_TRUE(queue.tryConsume(handler));
+    EXPECT_TRUE(queue.tryConsume(handler));
+    EXPECT_EQ(noise, (std::vector<std::string>{ "Meow!", "Woof, woof!" }));
+
+    // a heap allocated message can be moved out
+    MpscQueue<IPet, 4>::Ptr pet;
+    EXPECT_TRUE(queue.tryPop(pet));
+    ASSERT_TRUE(pet);
+    EXPECT_TRUE(pet.usesHeap());
+    EXPECT_EQ(pet->makeSomeNoise(), "Polly!");
+
+    // wraps around
+    EXPECT_TRUE(queue.tryEmplace<Dog>("Bob"));
+    EXPECT_TRUE(queue.tryConsume(handler));
+    EXPECT_TRUE(queue.tryConsume(handler));
+    EXPECT_FALSE(queue.tryConsume(handler));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(noise, (std::vector<std::string>{ "Meow!", "Woof, woof!", "Meow!", "Woof, woof!" }));
+}
+
+/// message for the multi-threaded test
+class QueueMessage
+{
+public:
+    QueueMessage(unsigned producer, unsigned sequence) : m_producer(producer), m_sequence(sequence)
+    {
+    }
+    virtual ~QueueMessage() = default;
+    QueueMessage(QueueMessage&&) = default;
+
+    unsigned producer() const noexcept { return m_producer; }
+    unsigned sequence() const noexcept { return m_sequence; }
+
+private:
+    unsigned m_producer;
+    unsigned m_sequence;
+};
+/// too large for the stack buffer
+class LargeQueueMessage : public QueueMessage
+{
+public:
+    using QueueMessage::QueueMessage;
+
+private:
+    char m_payload[128] = {};
+};
+
+TEST(MpscQueue, MultiProducer)
+{
+    constexpr unsigned numProducers = 4;
+    constexpr unsigned numMessages = 20000;
+    MpscQueue<QueueMessage, 64> queue;
+
+    std::vector<std::thread> producers;
+    for (unsigned producer = 0; producer < numProducers; ++producer)
+    {
+        producers.emplace_back([&queue, producer] {
+            for (unsigned i = 0; i < numMessages; ++i)
+            {
+                bool ok;
+                if (i % 8 == 0)
+                    ok = queue.tryEmplace<LargeQueueMessage>(producer, i);
+                else
+                    ok = queue.tryEmplace<QueueMessage>(producer, i);
+                if (!ok)
+                {
+                    std::this_thread::yield();
+                    --i;
+                }
+            }
+        });
+    }
+
+    // messages of each producer must arrive in order
+    std::vector<unsigned> next(numProducers, 0);
+    unsigned received = 0;
+    bool ordered = true;
+    while (received < numProducers * numMessages)
+    {
+        const bool consumed = queue.tryConsume([&](QueueMessage& msg) {
+            ordered = ordered && (msg.sequence() == next[msg.producer()]);
+            ++next[msg.producer()];
+        });
+        if (consumed)
+            ++received;
+        else
+            std::this_thread::yield();
+    }
+    for (std::thread& producer : producers)
+        producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(queue.empty());
+    for (unsigned count : next)
+        EXPECT_EQ(count, numMessages);
+}
+#endif
+
+#ifdef TEST_SMALL_FUNCTION
+static int twice(int value)
+{
+    return 2 * value;
+}
+
+TEST(SmallFunction, Invoke)
+{
+    SmallFunction<int(int)> f;
+    EXPECT_FALSE(f);
+    EXPECT_THROW(f(1), std::bad_function_call);
+
+    f = twice;
+    ASSERT_TRUE(f);
+    EXPECT_TRUE(f.usesStack());
+    EXPECT_EQ(f(21), 42);
+
+    int calls = 0;
+    f = [&calls](int value) { return value + ++calls; };
+    EXPECT_EQ(f(1), 2);
+    EXPECT_EQ(f(1), 3);
+
+    // a null function pointer results in an empty function (like std::function)
+    int (*null)(int) = nullptr;
+    f = null;
+    EXPECT_FALSE(f);
+
+    // std::function fits into the default buffer
+    SmallFunction<int(int)> wrapped = std::function<int(int)>(twice);
+    EXPECT_TRUE(wrapped.usesStack());
+    EXPECT_EQ(wrapped(2), 4);
+
+    // the result may be ignored
+    SmallFunction<void(int)> noResult(twice);
+    noResult(1);
+}
+
+TEST(SmallFunction, Storage)
+{
+    // too large for the buffer
+    std::array<int, 32> values{};
+    values[5] = 5;
+    SmallFunction<int(std::size_t)> large = [values](std::size_t i) { return values[i]; };
+    EXPECT_TRUE(large.usesHeap());
+    EXPECT_EQ(large(5), 5);
+
+    SmallFunction<int(std::size_t), 256> inlined = [values](std::size_t i) { return values[i]; };
+    EXPECT_TRUE(inlined.usesStack());
+    EXPECT_EQ(inlined(5), 5);
+
+    // moving keeps the callable
+    SmallFunction<int(std::size_t)> moved(std::move(large));
+    EXPECT_FALSE(large);
+    EXPECT_EQ(moved(5), 5);
+    SmallFunction<int(std::size_t), 256> movedInline(std::move(inlined));
+    EXPECT_FALSE(inlined);
+    EXPECT_EQ(movedInline(5), 5);
+}
+
+TEST(SmallFunction, MoveOnly)
+{
+    auto value = std::make_unique<int>(42);
+    SmallFunction<int()> f = [value = std::move(value)] { return *value; };
+    EXPECT_EQ(f(), 42);
+
+    // a hot callback list
+    std::vector<SmallFunction<int()>> callbacks;
+    callbacks.emplace_back(std::move(f));
+    for (int i = 0; i < 10; ++i)
+        callbacks.emplace_back([i] { return i; });
+    int sum = 0;
+    for (auto& cb : callbacks)
+        sum += cb();
+    EXPECT_EQ(sum, 42 + 45);
+}
+#endif
+
+#ifdef TEST_EMPLACE_STRONG
+/// a pet whose constructor may throw, optionally too large for the stack buffer
+template <std::size_t T_Size>
+class ThrowingPet : public IPet
+{
+public:
+    explicit ThrowingPet(bool fail)
+    {
+        if (fail)
+            throw std::runtime_error("no pet today");
+    }
+    ThrowingPet(ThrowingPet&&) noexcept = default;
+
+    std::string makeSomeNoise() final { return "Hiss!"; }
+
+private:
+    char m_data[T_Size] = {};
+};
+
+TEST(SmallPtr, EmplaceStrong)
+{
+    using SmallPet = ThrowingPet<8>;
+    using LargePet = ThrowingPet<256>;
+
+    SmallPtr<IPet> pet(InPlace<Cat>{});
+    // the plain emplace() destroys the old object first
+    EXPECT_THROW(pet.emplace<SmallPet>(true), std::runtime_error);
+    EXPECT_FALSE(pet);
+
+    pet.emplace<Cat>();
+    EXPECT_THROW(pet.emplaceStrong<SmallPet>(true), std::runtime_error);
+    ASSERT_TRUE(pet);
+    EXPECT_EQ(pet->makeSomeNoise(), "Meow!");
+    EXPECT_THROW(pet.emplaceStrong<LargePet>(true), std::runtime_error);
+    ASSERT_TRUE(pet);
+    EXPECT_EQ(pet->makeSomeNoise(), "Meow!");
+
+    // same storage as emplace() if nothing throws
+    pet.emplaceStrong<SmallPet>(false);
+    EXPECT_EQ(pet->makeSomeNoise(), "Hiss!");
+    EXPECT_TRUE(pet.usesStack());
+    pet.emplaceStrong<LargePet>(false);
+    EXPECT_EQ(pet->makeSomeNoise(), "Hiss!");
+    EXPECT_TRUE(pet.usesHeap());
+    pet.emplaceStrong<Cat>();
+    EXPECT_TRUE(pet.usesStack());
+
+    // dogs can only be copied (which may throw): a new dog takes the stack buffer if the current
+    // object can be set aside by memcpy (a cat or an object on the heap), else it goes to the heap
+    pet.emplaceStrong<Dog>("Rex");
+    EXPECT_EQ(pet->makeSomeNoise(), "Woof, woof!");
+    EXPECT_TRUE(pet.usesStack());
+    pet.emplaceStrong<Dog>("Rex");
+    EXPECT_TRUE(pet.usesHeap());
+    pet.emplaceStrong<Dog>("Rex");
+    EXPECT_TRUE(pet.usesStack());
+}
+
+TEST(SmallPtr, EmplaceStrongMoveFails)
+{
+    using LargePet = ThrowingPet<256>;
+    ClumsyPet::s_instances = 0;
+
+    // a dog in the stack buffer can't be set aside: the new object is moved to the heap
+    SmallPtr<IPet> pet(InPlace<Dog>{});
+    ClumsyPet::s_failingMoves = 1;
+    EXPECT_THROW(pet.emplaceStrong<ClumsyPet>(), std::runtime_error);
+    ASSERT_TRUE(pet);
+    EXPECT_EQ(pet->makeSomeNoise(), "Woof, woof!");
+    pet.emplaceStrong<ClumsyPet>();
+    EXPECT_EQ(pet->makeSomeNoise(), "Oops!");
+    EXPECT_TRUE(pet.usesHeap());
+
+    // an object on the heap is set aside, the new one is moved to the stack buffer ...
+    pet.emplaceStrong<ClumsyPet>();
+    EXPECT_TRUE(pet.usesStack());
+
+    // ... or to the heap if that move fails
+    pet.emplace<LargePet>(false);
+    ClumsyPet::s_failingMoves = 1;
+    pet.emplaceStrong<ClumsyPet>();
+    EXPECT_EQ(pet->makeSomeNoise(), "Oops!");
+    EXPECT_TRUE(pet.usesHeap());
+
+    // both moves fail: the cat that was set aside is kept
+    pet.emplace<Cat>();
+    ClumsyPet::s_failingMoves = 2;
+    EXPECT_THROW(pet.emplaceStrong<ClumsyPet>(), std::runtime_error);
+    ASSERT_TRUE(pet);
+    EXPECT_EQ(pet->makeSomeNoise(), "Meow!");
+    EXPECT_TRUE(pet.usesStack());
+    pet.reset();
+    EXPECT_EQ(ClumsyPet::s_instances, 0);
+}
+
+TEST(SmallPtr, SwapMoveFails)
+{
+    ClumsyPet::s_instances = 0;
+    {
+        SmallPtr<IPet> first(InPlace<ClumsyPet>{});
+        SmallPtr<IPet> second(InPlace<ClumsyPet>{});
+        SmallPtr<IPet> cat(InPlace<Cat>{});
+
+        // the clumsy pet is the only one that is moved: if that fails, nothing changes
+        ClumsyPet::s_failingMoves = 1;
+        EXPECT_THROW(first.swap(cat), std::runtime_error);
+        EXPECT_EQ(first->makeSomeNoise(), "Oops!");
+        EXPECT_EQ(cat->makeSomeNoise(), "Meow!");
+        EXPECT_EQ(ClumsyPet::s_instances, 2);
+
+        // like std::swap(): the second object is lost, but not leaked or destroyed twice
+        ClumsyPet::s_movesBeforeFailure = 1;
+        ClumsyPet::s_failingMoves = 1;
+        EXPECT_THROW(first.swap(second), std::runtime_error);
+        EXPECT_FALSE(second);
+        EXPECT_EQ(first->makeSomeNoise(), "Oops!");
+        EXPECT_EQ(ClumsyPet::s_instances, 1);
+
+        second.emplace<ClumsyPet>();
+        first.swap(second);
+        EXPECT_TRUE(first && second);
+    }
+    EXPECT_EQ(ClumsyPet::s_instances, 0);
+}
+#endif
+
+#ifdef TEST_SMALL_SHARED_PTR
+TEST(SmallSharedPtr, Sharing)
+{
+    using Pet = CountingPet<false>;
+    Pet::moves = 0;
+    Pet::destructions = 0;
+    {
+        SmallSharedPtr<IPet> pet(InPlace<Pet>{});
+        EXPECT_EQ(pet.useCount(), 1);
+        EXPECT_TRUE(pet.usesStack());
+        SmallSharedPtr<IPet> copy(pet);
+        EXPECT_EQ(pet.useCount(), 2);
+        EXPECT_EQ(copy.get(), pet.get());
+
+        SmallSharedPtr<IPet> moved(std::move(copy));
+        EXPECT_FALSE(copy);
+        EXPECT_EQ(moved.useCount(), 2);
+
+        pet = nullptr;
+        EXPECT_EQ(Pet::destructions, 0);
+        EXPECT_EQ(moved.useCount(), 1);
+        EXPECT_EQ(moved->makeSomeNoise(), "Tick!");
+    }
+    // destroyed once, never moved
+    EXPECT_EQ(Pet::destructions, 1);
+    EXPECT_EQ(Pet::moves, 0);
+}
+
+TEST(SmallSharedPtr, Storage)
+{
+    SmallSharedPtr<IPet> dog(InPlace<Dog>{}, "Rex");
+    EXPECT_TRUE(dog.usesStack());
+    // large objects are allocated separately
+    SmallSharedPtr<IPet> parrot(InPlace<Parrot>{}, "Polly");
+    EXPECT_TRUE(parrot.usesHeap());
+    EXPECT_EQ(parrot->makeSomeNoise(), "Polly!");
+    SmallSharedPtr<IPet> elephant(InPlace<Elephant>{}, 1, 2.0);
+    EXPECT_TRUE(elephant.usesHeap());
+
+    swap(dog, parrot);
+    EXPECT_EQ(dog->makeSomeNoise(), "Polly!");
+    dog = elephant;
+    EXPECT_EQ(elephant.useCount(), 2);
+    EXPECT_EQ(dog->makeSomeNoise(), "Toooooooooot!");
+
+    // single-threaded variant
+    SmallSharedPtr<IPet, 48, false> cat(InPlace<Cat>{});
+    auto copy = cat;
+    EXPECT_EQ(cat.useCount(), 2);
+    EXPECT_EQ(copy->makeSomeNoise(), "Meow!");
+}
+
+TEST(SmallSharedPtr, Threads)
+{
+    using Pet = CountingPet<true>;
+    Pet::destructions = 0;
+    {
+        SmallSharedPtr<IPet> pet(InPlace<Pet>{});
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            // each thread gets a copy, makes more copies and releases them
+            threads.emplace_back([copy = pet] {
+                for (int n = 0; n < 10000; ++n)
+                {
+                    SmallSharedPtr<IPet> local(copy);
+                    SmallSharedPtr<IPet> other(std::move(local));
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        EXPECT_EQ(pet.useCount(), 1);
+    }
+    EXPECT_EQ(Pet::destructions, 1);
+}
+#endif
+
+#ifdef TEST_SLAB_ALLOCATOR
+using SlabPtr = SmallPtr<IPet, 64, SlabAllocator<IPet>>;
+/// the pool of the size class that serves Parrots in a SlabPtr
+using ParrotBlock = HeapBlock<Parrot, SlabAllocator<IPet>>;
+using ParrotPool = SlabSizeClasses::Pool<SlabAllocator<ParrotBlock>::blockSize()>;
+
+TEST(SlabAllocator, SizeClasses)
+{
+    EXPECT_EQ(SlabSizeClasses::roundUp(1), 16u);
+    EXPECT_EQ(SlabSizeClasses::roundUp(64), 64u);
+    EXPECT_EQ(SlabSizeClasses::roundUp(65), 80u);
+    EXPECT_EQ(SlabSizeClasses::roundUp(1032), 1280u);
+    EXPECT_EQ(SlabSizeClasses::roundUp(4096), 4096u);
+    for (size_t bytes = 1; bytes <= SlabSizeClasses::maxSize; ++bytes)
+    {
+        const size_t index = SlabSizeClasses::indexOf(bytes);
+        ASSERT_EQ(SlabSizeClasses::sizeAt(index), SlabSizeClasses::roundUp(bytes)) << bytes;
+        // less than 20% lost (above 64 bytes)
+        if (bytes > 64)
+        {
+            ASSERT_LT(5 * (SlabSizeClasses::roundUp(bytes) - bytes),
+                      SlabSizeClasses::roundUp(bytes));
+        }
+    }
+    EXPECT_EQ(SlabSizeClasses::sizeAt(SlabSizeClasses::count() - 1), SlabSizeClasses::maxSize);
+
+    // arrays and large objects aren't pooled
+    EXPECT_EQ(SlabAllocator<Parrot>::blockSize(), 1280u);
+    EXPECT_EQ((SlabAllocator<std::array<char, 5000>>::blockSize()), 0u);
+}
+
+TEST(SlabAllocator, SmallPtr)
+{
+    const SlabStats before = ParrotPool::stats();
+    {
+        SlabPtr pet(InPlace<Parrot>{}, "Polly");
+        EXPECT_TRUE(pet.usesHeap());
+        EXPECT_EQ(pet->makeSomeNoise(), "Polly!");
+
+        const SlabStats stats = ParrotPool::stats();
+        EXPECT_EQ(stats.blockSize, 1280u);
+        EXPECT_EQ(stats.used, before.used + 1);
+        EXPECT_EQ(stats.requestedBytes, before.requestedBytes + sizeof(ParrotBlock));
+        EXPECT_GT(stats.occupancy(), 0.0);
+        EXPECT_GT(stats.fragmentation(), 0.0);
+        EXPECT_LT(stats.fragmentation(), 0.2);
+
+        // the block is reused right away
+        const IPet* first = pet.get();
+        pet.emplace<Parrot>("Coco");
+        EXPECT_EQ(pet.get(), first);
+
+        // non-movable types are on the heap, too
+        SlabPtr elephant(InPlace<Elephant>{}, 1, 2.0);
+        EXPECT_TRUE(elephant.usesHeap());
+        EXPECT_EQ(elephant->makeSomeNoise(), "Toooooooooot!");
+    }
+    EXPECT_EQ(ParrotPool::stats().used, before.used);
+
+    std::ostringstream os;
+    SlabSizeClasses::dump(os);
+    EXPECT_NE(os.str().find("1280"), std::string::npos);
+}
+
+TEST(SlabAllocator, Threads)
+{
+    const SlabStats before = ParrotPool::stats();
+    std::vector<SlabPtr> pets;
+    // allocated by another thread, freed by this one
+    std::thread producer([&pets] {
+        for (int i = 0; i < 1000; ++i)
+            pets.emplace_back(InPlace<Parrot>{}, "Polly");
+    });
+    producer.join();
+    EXPECT_EQ(ParrotPool::stats().used, before.used + 1000);
+
+    pets.clear();
+    const SlabStats after = ParrotPool::stats();
+    EXPECT_EQ(after.used, before.used);
+    // this thread only keeps a few of the blocks, the rest is in the refill list
+    EXPECT_GE(after.refillBlocks, 1000 - 2 * ParrotPool::batchSize);
+}
+#endif
+
+#ifdef TEST_ALIGNMENT
+/// a counter on its own cache line
+class alignas(64) CoreCounter : public IPet
+{
+public:
+    std::string makeSomeNoise() override { return std::to_string(count); }
+
+    long count = 0;
+};
+
+bool isAligned(const IPet* pet, std::size_t alignment)
+{
+    const auto* counter = dynamic_cast<const CoreCounter*>(pet);
+    return reinterpret_cast<std::uintptr_t>(counter) % alignment == 0;
+}
+
+TEST(StackSize, OverAligned)
+{
+    // the counter is small enough, but not for the default buffer alignment
+    using Pets = StackSizeReport<TypeList<Cat, CoreCounter>>;
+    static_assert(Pets::stackSizeFor(100) == sizeof(Cat), "");
+    static_assert(std::is_same<Pets::Spilled<128>, TypeList<CoreCounter>>::value, "");
+    static_assert(!SmallPtr<IPet, 128>::fitsInline<CoreCounter>(), "same as SmallPtr");
+
+    using Counters = StackSizeReport<TypeList<Cat, CoreCounter>, 64>;
+    static_assert(Counters::stackSizeFor(100) == sizeof(CoreCounter), "");
+    static_assert(std::is_same<Counters::Inline<64>, TypeList<Cat, CoreCounter>>::value, "");
+    using CounterPtr = SmallPtr<IPet, 64, std::allocator<IPet>, 64>;
+    static_assert(CounterPtr::fitsInline<CoreCounter>(), "same as SmallPtr");
+}
+
+TEST(SmallPtr, OverAligned)
+{
+    // the default buffer isn't aligned enough -> aligned heap allocation
+    using PetPtr = SmallPtr<IPet, 128>;
+    static_assert(!PetPtr::fitsInline<CoreCounter>(), "must not be inline");
+    PetPtr pet(InPlace<CoreCounter>{});
+    EXPECT_TRUE(pet.usesHeap());
+    EXPECT_TRUE(isAligned(pet.get(), 64));
+
+    using CounterPtr = SmallPtr<IPet, 64, std::allocator<IPet>, 64>;
+    static_assert(CounterPtr::fitsInline<CoreCounter>(), "must be inline");
+    static_assert(alignof(CounterPtr) == 64, "buffer must be aligned");
+
+    std::vector<CounterPtr> counters;
+    for (int i = 0; i < 10; ++i)
+    {
+        // growing the vector moves the counters
+        counters.emplace_back(InPlace<CoreCounter>{});
+        dynamic_cast<CoreCounter&>(*counters.back()).count = i;
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        CounterPtr& counter = counters[static_cast<size_t>(i)];
+        EXPECT_TRUE(counter.usesStack());
+        EXPECT_TRUE(isAligned(counter.get(), 64));
+        EXPECT_EQ(counter->makeSomeNoise(), std::to_string(i));
+    }
+
+    swap(counters[0], counters[1]);
+    EXPECT_EQ(counters[0]->makeSomeNoise(), "1");
+    EXPECT_TRUE(isAligned(counters[0].get(), 64));
+    counters[2].emplaceStrong<CoreCounter>();
+    EXPECT_TRUE(counters[2].usesStack());
+    EXPECT_TRUE(isAligned(counters[2].get(), 64));
+
+    SmallValue<IPet> value(InPlace<CoreCounter>{});
+    SmallValue<IPet> copy(value);
+    EXPECT_TRUE(isAligned(value.get(), 64));
+    EXPECT_TRUE(isAligned(copy.get(), 64));
+}
+#endif
+
+#ifdef TEST_CONSTEXPR
+class Shape
+{
+public:
+    constexpr virtual ~Shape() = default;
+    constexpr virtual int area() const = 0;
+};
+class Square : public Shape
+{
+public:
+    constexpr explicit Square(int side) : m_side(side) {}
+    // GCC 12 can't call a defaulted virtual destructor in constant evaluation
+    constexpr ~Square() override {}
+    constexpr int area() const override { return m_side * m_side; }
+
+private:
+    int m_side;
+};
+/// too large for the stack buffer at runtime
+class Polygon : public Shape
+{
+public:
+    constexpr explicit Polygon(int numPoints) : m_numPoints(numPoints) {}
+    constexpr ~Polygon() override {}
+    constexpr int area() const override { return m_numPoints; }
+
+private:
+    int m_numPoints;
+    int m_points[64] = {};
+};
+
+/// builds polymorphic objects at compile time, only the result is kept
+constexpr std::array<int, 4> compileTimeAreas()
+{
+    std::array<SmallPtr<Shape>, 3> shapes;
+    shapes[0].emplace<Square>(3);
+    shapes[1].emplace<Polygon>(5);
+    shapes[2] = SmallPtr<Shape>(InPlace<Square>{}, 4);
+
+    // moving and resetting
+    SmallPtr<Shape> moved(std::move(shapes[2]));
+    shapes[2].reset(new Square(2));
+
+    std::array<int, 4> areas{};
+    for (std::size_t i = 0; i < shapes.size(); ++i)
+        areas[i] = shapes[i]->area();
+    areas[3] = moved->area() + (moved.usesHeap() ? 1000 : 0);
+    return areas;
+}
+
+TEST(SmallPtr, Constexpr)
+{
+    constexpr std::array<int, 4> areas = compileTimeAreas();
+    static_assert(areas[0] == 9 && areas[1] == 5 && areas[2] == 4, "");
+    // always on the heap during constant evaluation
+    static_assert(areas[3] == 1016, "");
+
+    // the same code at runtime uses the stack buffer
+    EXPECT_EQ(compileTimeAreas()[0], 9);
+    SmallPtr<Shape> square(InPlace<Square>{}, 3);
+    EXPECT_TRUE(square.usesStack());
+    SmallPtr<Shape> polygon(InPlace<Polygon>{}, 5);
+    EXPECT_TRUE(polygon.usesHeap());
+}
+#endif
+
+#ifdef SMALLPTR_ENABLE_STATS
+TEST(SmallPtr, Statistics)
+{
+    SmallPtrStats& stats = SmallPtrStats::instance();
+    stats.reset();
+
+    SmallPtr<IPet> pet(InPlace<Cat>{});
+    pet.emplace<Dog>("Rex");
+    pet.emplace<Parrot>("Polly");
+    pet.emplace<Parrot>("Coco");
+    pet.emplace<Elephant>(1, 2.0);
+
+    EXPECT_EQ(SmallPtrStats::forType<Cat>().stackHits, 1u);
+    EXPECT_EQ(SmallPtrStats::forType<Cat>().heapFallbacks, 0u);
+    EXPECT_EQ(SmallPtrStats::forType<Dog>().stackHits, 1u);
+    EXPECT_EQ(SmallPtrStats::forType<Parrot>().stackHits, 0u);
+    EXPECT_EQ(SmallPtrStats::forType<Parrot>().heapFallbacks, 2u);
+    EXPECT_EQ(SmallPtrStats::forType<Parrot>().heapBytes,
+              2 * sizeof(HeapBlock<Parrot, std::allocator<IPet>>));
+    // non-movable -> heap, even though it would fit
+    EXPECT_EQ(SmallPtrStats::forType<Elephant>().heapFallbacks, 1u);
+
+    // the block holds the allocator as well
+    using PmrBlock = HeapBlock<Parrot, std::pmr::polymorphic_allocator<IPet>>;
+    static_assert(sizeof(PmrBlock) > sizeof(Parrot), "");
+    SmallPtr<IPet, 64, std::pmr::polymorphic_allocator<IPet>> pmrPet(InPlace<Parrot>{}, "Lori");
+    EXPECT_EQ(SmallPtrStats::forType<Parrot>().heapBytes,
+              2 * sizeof(HeapBlock<Parrot, std::allocator<IPet>>) + sizeof(PmrBlock));
+
+    std::ostringstream os;
+    stats.dump(os);
+    EXPECT_NE(os.str().find("Parrot"), std::string::npos);
+    EXPECT_NE(os.str().find("Elephant"), std::string::npos);
+
+    stats.reset();
+    EXPECT_EQ(SmallPtrStats::forType<Parrot>().heapFallbacks, 0u);
+}
+#endif
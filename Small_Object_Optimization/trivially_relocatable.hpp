@@ -0,0 +1,22 @@
+/**
+ * @file    trivially_relocatable.hpp
+ * @brief   trait for types that may be moved to another address by copying their bytes
+ */
+
+#pragma once
+
+#include <type_traits>
+
+/**
+ * A type is trivially relocatable if "move-construct at the new address + destroy the old object"
+ * has the same effect as copying the bytes (and forgetting about the old object). This is true
+ * for all trivially copyable types, but also for many classes with a vtable or a user-defined
+ * destructor - specialize this trait for them.
+ *
+ * Note: it's NOT true for objects that point into themselves, like libstdc++'s std::string
+ * (small string optimization).
+ */
+template <class T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T>
+{
+};
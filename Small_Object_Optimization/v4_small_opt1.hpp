@@ -109,7 +109,11 @@ public:
     SmallPtr(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */ { assign(rhs); }
     SmallPtr& operator=(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */
     {
-        assign(rhs);
+        if (this != &rhs)
+        {
+            reset();
+            assign(rhs);
+        }
         return *this;
     }
     SmallPtr& operator=(std::nullptr_t) noexcept
@@ -142,10 +142,14 @@ public:
         emplace<Derived>(std::forward<Args>(args)...);
     }
 
-    SmallPtr(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */ { assign(rhs); }
+    SmallPtr(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */ : m_ptr(nullptr) { assign(rhs); }
     SmallPtr& operator=(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */
     {
-        assign(rhs);
+        if (this != &rhs)
+        {
+            reset();
+            assign(rhs);
+        }
         return *this;
     }
     SmallPtr& operator=(std::nullptr_t) noexcept
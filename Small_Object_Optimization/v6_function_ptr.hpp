@@ -5,15 +5,44 @@
 
 #pragma once
 
+#include <cstring>
+#include <memory>
 #include <type_traits>
 #include <utility>
 
+#include "trivially_relocatable.hpp"
+
+#ifdef SMALLPTR_ENABLE_STATS
+#include "smallptr_stats.hpp"
+#endif
+
+// C++20: SmallPtr can be used in constant expressions (see ConstexprStorage)
+#if defined(__cpp_constexpr_dynamic_alloc) && defined(__cpp_lib_is_constant_evaluated)
+#define SMALLPTR_HAS_CONSTEXPR 1
+#define SMALLPTR_CONSTEXPR constexpr
+#else
+#define SMALLPTR_HAS_CONSTEXPR 0
+#define SMALLPTR_CONSTEXPR
+#endif
+
+/// std::is_constant_evaluated(), always false before C++20
+constexpr bool smallPtrConstantEvaluated() noexcept
+{
+#if SMALLPTR_HAS_CONSTEXPR
+    return std::is_constant_evaluated();
+#else
+    return false;
+#endif
+}
+
 enum class Action
 {
     get_const,
     get_nonconst,
-    move_to,
+    move_to, ///< move to another buffer and destroy the source ("relocate")
+    copy_to, ///< only supported by copyable storages (see small_value.hpp)
     uses_heap,
+    relocatable, ///< can the object be moved to another buffer by memcpy (see swap())?
     destroy
 };
 
@@ -35,21 +64,38 @@ struct ParamTypes
         void* stackFrom;
         void* stackTo;
     };
+    struct CopyTo
+    {
+        const void* stackFrom;
+        void* stackTo;
+    };
     struct UsesHeap
     {
         bool value;
     };
+    struct Relocatable
+    {
+        bool value;
+    };
     struct Destroy
     {
         void* stack;
     };
+    /// only used in constant evaluation: the object itself (see ConstexprStorage)
+    struct Object
+    {
+        T* ptr;
+    };
 
     using Param = union {
         GetConst getConst;
         GetNonConst getNonConst;
         MoveTo moveTo;
+        CopyTo copyTo;
         UsesHeap usesHeap;
+        Relocatable relocatable;
         Destroy destroy;
+        Object object;
     };
 };
 
@@ -75,6 +121,9 @@ public:
         case Action::uses_heap:
             usesHeap(param.usesHeap);
             break;
+        case Action::relocatable:
+            param.relocatable.value = IsTriviallyRelocatable<Derived>::value;
+            break;
         case Action::destroy:
             destroy(param.destroy);
             break;
@@ -85,8 +134,16 @@ public:
 
     static void moveTo(typename Params::MoveTo& param)
     {
-        Derived* fromPtr = reinterpret_cast<Derived*>(param.stackFrom);
-        ::new (param.stackTo) Derived(std::move(*fromPtr));
+        if constexpr (IsTriviallyRelocatable<Derived>::value)
+        {
+            memcpy(param.stackTo, param.stackFrom, sizeof(Derived));
+        }
+        else
+        {
+            Derived* fromPtr = reinterpret_cast<Derived*>(param.stackFrom);
+            ::new (param.stackTo) Derived(std::move(*fromPtr));
+            fromPtr->~Derived();
+        }
     }
     static void get(typename Params::GetNonConst& param)
     {
@@ -125,6 +182,9 @@ public:
         case Action::uses_heap:
             usesHeap(param.usesHeap);
             break;
+        case Action::relocatable:
+            param.relocatable.value = true;
+            break;
         case Action::destroy:
             destroy(param.destroy);
             break;
@@ -164,24 +224,183 @@ public:
     static void set(void* stack, Derived* ptr) { memcpy(stack, &ptr, sizeof(ptr)); }
 };
 
+/// heap allocated object, together with the allocator that has to free it again
+template <class Derived, class Alloc>
+class HeapBlock
+  : private std::allocator_traits<Alloc>::template rebind_alloc<HeapBlock<Derived, Alloc>>
+{
+public:
+    using BlockAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<HeapBlock<Derived, Alloc>>;
+    using BlockTraits = std::allocator_traits<BlockAlloc>;
+
+    template <class... Args>
+    HeapBlock(const BlockAlloc& alloc, Args&&... args)
+      : BlockAlloc(alloc), m_instance(std::forward<Args>(args)...)
+    {
+    }
+
+    BlockAlloc allocator() const noexcept { return *this; }
+    Derived* get() noexcept { return &m_instance; }
+
+private:
+    Derived m_instance;
+};
+
+/// like HeapStorage, but uses an allocator instead of new/delete
+template <class Derived, class Base, class Alloc>
+class AllocatedStorage
+{
+public:
+    using Params = ParamTypes<Base>;
+    using Block = HeapBlock<Derived, Alloc>;
+    using BlockAlloc = typename Block::BlockAlloc;
+    using BlockTraits = typename Block::BlockTraits;
+
+    static void execute(Action action, typename Params::Param& param)
+    {
+        switch (action)
+        {
+        case Action::get_const:
+            get(param.getConst);
+            break;
+        case Action::get_nonconst:
+            get(param.getNonConst);
+            break;
+        case Action::move_to:
+            moveTo(param.moveTo);
+            break;
+        case Action::uses_heap:
+            usesHeap(param.usesHeap);
+            break;
+        case Action::relocatable:
+            param.relocatable.value = true;
+            break;
+        case Action::destroy:
+            destroy(param.destroy);
+            break;
+        default:
+            break;
+        }
+    }
+
+    template <class... Args>
+    static void create(void* stack, const Alloc& alloc, Args&&... args)
+    {
+        BlockAlloc blockAlloc(alloc);
+        Block* block = BlockTraits::allocate(blockAlloc, 1);
+        try
+        {
+            ::new (static_cast<void*>(block)) Block(blockAlloc, std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            BlockTraits::deallocate(blockAlloc, block, 1);
+            throw;
+        }
+        set(stack, block);
+    }
+
+    static void moveTo(typename Params::MoveTo& param)
+    {
+        memcpy(param.stackTo, param.stackFrom, sizeof(Block*));
+        set(param.stackFrom, nullptr);
+    }
+    static void get(typename Params::GetNonConst& param) { param.ptr = load(param.stack)->get(); }
+    static void get(typename Params::GetConst& param) { param.ptr = load(param.stack)->get(); }
+    static void usesHeap(typename Params::UsesHeap& param) { param.value = true; }
+    static void destroy(typename Params::Destroy& param)
+    {
+        Block* block = load(param.stack);
+        if (block)
+        {
+            // the block owns the allocator -> copy it before destroying the block
+            BlockAlloc blockAlloc(block->allocator());
+            block->~Block();
+            BlockTraits::deallocate(blockAlloc, block, 1);
+            set(param.stack, nullptr);
+        }
+    }
+
+private:
+    static Block* load(const void* stack)
+    {
+        Block* block;
+        memcpy(&block, stack, sizeof(block));
+        return block;
+    }
+    static void set(void* stack, Block* block) { memcpy(stack, &block, sizeof(block)); }
+};
+
+/**
+ * Storage used during constant evaluation: an object can't be placed into a raw buffer there
+ * (neither placement new nor std::construct_at nor std::bit_cast work on it), so it's always
+ * allocated with (constexpr) new and SmallPtr keeps the pointer itself. The storage function is
+ * only needed to destroy the object with its real type.
+ *
+ * Note that objects allocated during constant evaluation must be destroyed before it ends, so
+ * a SmallPtr that holds an object can't be a constexpr variable (but a constexpr function can
+ * use SmallPtrs to compute a table, for example).
+ */
+template <class Derived, class Base>
+class ConstexprStorage
+{
+public:
+    using Params = ParamTypes<Base>;
+    static SMALLPTR_CONSTEXPR void execute(Action action, typename Params::Param& param)
+    {
+        switch (action)
+        {
+        case Action::uses_heap:
+            param.usesHeap.value = true;
+            break;
+        case Action::destroy:
+            delete static_cast<Derived*>(param.object.ptr);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
 /// dummy class that only transports type information
 template <class T>
 class InPlace
 {
 };
 
-template <class T, size_t T_StackSize = 64>
-class SmallPtr
+/**
+ * Objects that don't fit into the stack buffer are allocated using @a Alloc (e.g. a
+ * std::pmr::polymorphic_allocator). The allocator is stored as (empty) base class, so the default
+ * std::allocator doesn't cost any space.
+ *
+ * @a T_Alignment is the alignment of the stack buffer. Objects with a larger alignment (e.g.
+ * alignas(64) counters) are put on the heap, where the allocator takes care of the alignment
+ * (std::allocator uses the aligned operator new). To keep them inline, use a larger alignment:
+ *   SmallPtr<ICounter, 64, std::allocator<ICounter>, 64>
+ */
+template <class T, size_t T_StackSize = 64, class Alloc = std::allocator<T>,
+          size_t T_Alignment = alignof(void*)>
+class SmallPtr : private Alloc
 {
 private:
     static_assert(!std::is_array<T>::value, "arrays not supported");
-    static constexpr std::size_t alignment = alignof(void*);
+    static_assert(T_Alignment >= alignof(void*) && (T_Alignment & (T_Alignment - 1)) == 0,
+                  "alignment must be a power of 2, at least that of a pointer");
+    static constexpr std::size_t alignment = T_Alignment;
 
     using Params = typename ParamTypes<T>::Param;
     using StorageFunc = void (*)(Action, Params&);
 
+    /// the stack buffer - or the object in constant evaluation (nullptr if there is none)
+    union StackBuffer
+    {
+        typename std::aligned_storage<T_StackSize, alignment>::type bytes;
+        T* object;
+    };
+
     StorageFunc m_ptr;
-    typename std::aligned_storage<T_StackSize, alignment>::type m_stack;
+    StackBuffer m_stack;
 
     // tag dispatching
     struct stack_tag
@@ -191,8 +410,28 @@ private:
     {
     };
 
-    T* getPtr() noexcept
+    /**
+     * Whether there is an object. In constant evaluation, the object pointer tells: m_ptr can't
+     * be compared with nullptr there if the null pointer checks of the compiler are disabled
+     * (e.g. by -fsanitize=undefined).
+     */
+    SMALLPTR_CONSTEXPR bool engaged() const noexcept
+    {
+        if (smallPtrConstantEvaluated())
+            return m_stack.object != nullptr;
+        return m_ptr != nullptr;
+    }
+    /// in constant evaluation, the object pointer must be initialized before engaged() is used
+    SMALLPTR_CONSTEXPR void initConstexpr() noexcept
+    {
+        if (smallPtrConstantEvaluated())
+            m_stack.object = nullptr;
+    }
+
+    SMALLPTR_CONSTEXPR T* getPtr() noexcept
     {
+        if (smallPtrConstantEvaluated())
+            return m_stack.object;
         if (m_ptr)
         {
             Params p;
@@ -202,8 +441,10 @@ private:
         }
         return nullptr;
     }
-    const T* getPtr() const noexcept
+    SMALLPTR_CONSTEXPR const T* getPtr() const noexcept
     {
+        if (smallPtrConstantEvaluated())
+            return m_stack.object;
         if (m_ptr)
         {
             Params p;
@@ -215,23 +456,52 @@ private:
     }
 
 public:
-    SmallPtr() noexcept : m_ptr(nullptr) {}
-    explicit SmallPtr(T* ptr) noexcept : m_ptr(nullptr) { reset(ptr); }
-    ~SmallPtr() { reset(); }
+    using allocator_type = Alloc;
+
+    SMALLPTR_CONSTEXPR SmallPtr() noexcept : m_ptr(nullptr) { initConstexpr(); }
+    SMALLPTR_CONSTEXPR explicit SmallPtr(const Alloc& alloc) noexcept : Alloc(alloc), m_ptr(nullptr)
+    {
+        initConstexpr();
+    }
+    SMALLPTR_CONSTEXPR explicit SmallPtr(T* ptr) noexcept : m_ptr(nullptr)
+    {
+        initConstexpr();
+        reset(ptr);
+    }
+    SMALLPTR_CONSTEXPR ~SmallPtr() { reset(); }
 
     template <class Derived, class... Args>
-    explicit SmallPtr(InPlace<Derived>, Args&&... args) : m_ptr(nullptr)
+    SMALLPTR_CONSTEXPR explicit SmallPtr(InPlace<Derived>, Args&&... args) : m_ptr(nullptr)
+    {
+        initConstexpr();
+        emplace<Derived>(std::forward<Args>(args)...);
+    }
+    template <class Derived, class... Args>
+    SMALLPTR_CONSTEXPR SmallPtr(std::allocator_arg_t, const Alloc& alloc, InPlace<Derived>,
+                                Args&&... args)
+      : Alloc(alloc), m_ptr(nullptr)
     {
+        initConstexpr();
         emplace<Derived>(std::forward<Args>(args)...);
     }
 
-    SmallPtr(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */ { assign(rhs); }
-    SmallPtr& operator=(SmallPtr<T, T_StackSize>&& rhs) /* noexcept */
+    // heap objects carry their own allocator, so the allocator isn't propagated on assignment
+    SMALLPTR_CONSTEXPR SmallPtr(SmallPtr&& rhs) /* noexcept */
+      : Alloc(rhs.get_allocator()), m_ptr(nullptr)
     {
+        initConstexpr();
         assign(rhs);
+    }
+    SMALLPTR_CONSTEXPR SmallPtr& operator=(SmallPtr&& rhs) /* noexcept */
+    {
+        if (this != &rhs)
+        {
+            reset();
+            assign(rhs);
+        }
         return *this;
     }
-    SmallPtr& operator=(std::nullptr_t) noexcept
+    SMALLPTR_CONSTEXPR SmallPtr& operator=(std::nullptr_t) noexcept
     {
         reset();
         return *this;
@@ -240,16 +510,75 @@ public:
     SmallPtr(const SmallPtr&) = delete;
     SmallPtr& operator=(const SmallPtr&) = delete;
 
-    // void swap(SmallPtr& rhs) noexcept { TODO; }
+    /**
+     * Exchanges the objects. Objects on the heap or trivially relocatable objects are exchanged
+     * by memcpy, so if one of them is, the other object is moved only once (if that move throws,
+     * nothing is changed). Otherwise, it's the same as std::swap(): three moves, and if one of
+     * them throws, an object may be lost (but none is leaked or destroyed twice). Like move
+     * assignment, the allocators stay where they are.
+     */
+    SMALLPTR_CONSTEXPR void swap(SmallPtr& rhs) /* noexcept */
+    {
+        if (this == &rhs)
+            return;
+        if (smallPtrConstantEvaluated())
+        {
+            std::swap(m_stack.object, rhs.m_stack.object);
+        }
+        else
+        {
+            const bool lhsRelocatable = relocatable(m_ptr);
+            const bool rhsRelocatable = relocatable(rhs.m_ptr);
+            StackBuffer tmp;
+            if (lhsRelocatable && rhsRelocatable)
+            {
+                // just exchange the buffers
+                memcpy(&tmp, &m_stack, sizeof(StackBuffer));
+                memcpy(&m_stack, &rhs.m_stack, sizeof(StackBuffer));
+                memcpy(&rhs.m_stack, &tmp, sizeof(StackBuffer));
+            }
+            else if (lhsRelocatable || rhsRelocatable)
+            {
+                // the other object is moved only once, directly to its new place
+                SmallPtr& bitwise = lhsRelocatable ? *this : rhs;
+                SmallPtr& other = lhsRelocatable ? rhs : *this;
+                memcpy(&tmp, &bitwise.m_stack, sizeof(StackBuffer));
+                try
+                {
+                    relocate(other.m_ptr, &other.m_stack, &bitwise.m_stack);
+                }
+                catch (...)
+                {
+                    // the other object hasn't been destroyed, only this buffer may be clobbered
+                    memcpy(&bitwise.m_stack, &tmp, sizeof(StackBuffer));
+                    throw;
+                }
+                memcpy(&other.m_stack, &tmp, sizeof(StackBuffer));
+            }
+            else
+            {
+                // a raw buffer would hold an object without an owner if a move threw
+                SmallPtr other(std::move(rhs));
+                rhs = std::move(*this);
+                *this = std::move(other);
+                return;
+            }
+        }
+        std::swap(m_ptr, rhs.m_ptr);
+    }
 
-    void reset(T* ptr = nullptr) noexcept
+    SMALLPTR_CONSTEXPR void reset(T* ptr = nullptr) noexcept
     {
-        if (m_ptr)
+        if (engaged())
         {
             Params p;
-            p.destroy.stack = &m_stack;
+            if (smallPtrConstantEvaluated())
+                p.object.ptr = m_stack.object;
+            else
+                p.destroy.stack = &m_stack;
             m_ptr(Action::destroy, p);
             m_ptr = nullptr;
+            initConstexpr();
         }
         if (ptr)
         {
@@ -257,86 +586,266 @@ public:
         }
     }
 
+    SMALLPTR_CONSTEXPR Alloc get_allocator() const noexcept { return *this; }
+
     // access functions/operator
-    T* get() noexcept { return getPtr(); }
-    const T* get() const noexcept { return getPtr(); }
+    SMALLPTR_CONSTEXPR T* get() noexcept { return getPtr(); }
+    SMALLPTR_CONSTEXPR const T* get() const noexcept { return getPtr(); }
 
-    T* operator->() noexcept { return get(); }
-    const T* operator->() const noexcept { return get(); }
+    SMALLPTR_CONSTEXPR T* operator->() noexcept { return get(); }
+    SMALLPTR_CONSTEXPR const T* operator->() const noexcept { return get(); }
 
-    T& operator*() noexcept { return *get(); }
-    const T& operator*() const noexcept { return *get(); }
+    SMALLPTR_CONSTEXPR T& operator*() noexcept { return *get(); }
+    SMALLPTR_CONSTEXPR const T& operator*() const noexcept { return *get(); }
 
     // check functions
-    bool operator==(std::nullptr_t) const noexcept { return get() == nullptr; }
-    bool operator!=(std::nullptr_t) const noexcept { return get() != nullptr; }
-    explicit operator bool() const noexcept { return *this != nullptr; }
+    SMALLPTR_CONSTEXPR bool operator==(std::nullptr_t) const noexcept { return get() == nullptr; }
+    SMALLPTR_CONSTEXPR bool operator!=(std::nullptr_t) const noexcept { return get() != nullptr; }
+    SMALLPTR_CONSTEXPR explicit operator bool() const noexcept { return *this != nullptr; }
 
-    bool usesHeap() const noexcept
+    SMALLPTR_CONSTEXPR bool usesHeap() const noexcept
     {
-        if (!m_ptr)
+        if (!engaged())
             return false;
         Params p;
         m_ptr(Action::uses_heap, p);
         return p.usesHeap.value;
     }
-    bool usesStack() const noexcept { return !usesHeap(); }
+    SMALLPTR_CONSTEXPR bool usesStack() const noexcept { return !usesHeap(); }
 
     template <class Derived, class... Args>
-    void emplace(Args&&... args)
+    SMALLPTR_CONSTEXPR void emplace(Args&&... args)
     {
         static_assert(std::is_same<T, Derived>::value or std::is_base_of<T, Derived>::value,
                       "may only use sub-classes of T!");
         static_assert(std::is_constructible<Derived, Args...>::value, "cannot instantiate!");
 
         reset();
-        constexpr bool smallFit = (sizeof(Derived) <= T_StackSize);
-        emplaceImpl<Derived>(std::conditional_t < smallFit &&
-                               std::is_move_constructible<Derived>::value,
-                             stack_tag, heap_tag > {}, std::forward<Args>(args)...);
+        if (smallPtrConstantEvaluated())
+        {
+            m_stack.object = new Derived(std::forward<Args>(args)...);
+            m_ptr = ConstexprStorage<Derived, T>::execute;
+            return;
+        }
+        emplaceImpl<Derived>(StorageTag<Derived>{}, std::forward<Args>(args)...);
+    }
+
+    /**
+     * Like emplace(), but with strong exception guarantee: if constructing (or moving) the new
+     * object fails, the current object is kept. The new object is constructed before the current
+     * one is destroyed - small objects in a scratch buffer on the call stack, so the size of
+     * SmallPtr doesn't change. They end up in the stack buffer like with emplace() if moving them
+     * can't throw, or if the current object can be set aside by memcpy (on the heap or trivially
+     * relocatable) and restored if the move throws. Otherwise, they're moved to the heap.
+     */
+    template <class Derived, class... Args>
+    void emplaceStrong(Args&&... args)
+    {
+        static_assert(std::is_same<T, Derived>::value or std::is_base_of<T, Derived>::value,
+                      "may only use sub-classes of T!");
+        static_assert(std::is_constructible<Derived, Args...>::value, "cannot instantiate!");
+
+        constexpr bool onStack = std::is_same<StorageTag<Derived>, stack_tag>::value;
+        if constexpr (onStack && std::is_nothrow_constructible<Derived, Args...>::value)
+        {
+            // nothing can fail after the current object is gone
+            emplace<Derived>(std::forward<Args>(args)...);
+        }
+        else if constexpr (onStack)
+        {
+            typename std::aligned_storage<sizeof(Derived), alignof(Derived)>::type scratch;
+            Derived* object =
+              ::new (static_cast<void*>(&scratch)) Derived(std::forward<Args>(args)...);
+            if constexpr (std::is_nothrow_move_constructible<Derived>::value)
+            {
+                reset();
+                relocate(StackStorage<Derived, T>::execute, &scratch, &m_stack);
+            }
+            else
+            {
+                if (!relocatable(m_ptr))
+                {
+                    replaceByHeap(object);
+                    return;
+                }
+                StackBuffer old;
+                memcpy(&old, &m_stack, sizeof(StackBuffer));
+                try
+                {
+                    // destroys the scratch object, unless its move constructor throws
+                    relocate(StackStorage<Derived, T>::execute, &scratch, &m_stack);
+                }
+                catch (...)
+                {
+                    // the current object hasn't been touched, only the buffer may be clobbered
+                    memcpy(&m_stack, &old, sizeof(StackBuffer));
+                    replaceByHeap(object);
+                    return;
+                }
+                if (m_ptr)
+                {
+                    Params p;
+                    p.destroy.stack = &old;
+                    m_ptr(Action::destroy, p);
+                }
+            }
+            m_ptr = StackStorage<Derived, T>::execute;
+#ifdef SMALLPTR_ENABLE_STATS
+            SmallPtrStats::recordStack<Derived>();
+#endif
+        }
+        else
+        {
+            using Storage = AllocatedStorage<Derived, T, Alloc>;
+            typename std::aligned_storage<sizeof(void*), alignof(void*)>::type block;
+            Storage::create(&block, get_allocator(), std::forward<Args>(args)...);
+            reset();
+            memcpy(&m_stack, &block, sizeof(void*));
+            m_ptr = Storage::execute;
+#ifdef SMALLPTR_ENABLE_STATS
+            SmallPtrStats::recordHeap<Derived>(sizeof(typename Storage::Block));
+#endif
+        }
+    }
+
+    /// the storage function of the current object (identifies its type and storage)
+    SMALLPTR_CONSTEXPR StorageFunc dispatch() const noexcept { return m_ptr; }
+
+    /// the storage function emplace<Derived>() uses
+    template <class Derived>
+    static constexpr StorageFunc dispatchFor() noexcept
+    {
+        return storageFunc<Derived>(StorageTag<Derived>{});
+    }
+
+    /// whether emplace<Derived>() uses the stack buffer (e.g. for a static_assert)
+    template <class Derived>
+    static constexpr bool fitsInline() noexcept
+    {
+        return (sizeof(Derived) <= T_StackSize) && (alignof(Derived) <= alignment) &&
+               std::is_move_constructible<Derived>::value;
     }
 
 private:
+    template <class Derived>
+    using StorageTag = std::conditional_t<fitsInline<Derived>(), stack_tag, heap_tag>;
+
+    template <class Derived>
+    static constexpr StorageFunc storageFunc(stack_tag) noexcept
+    {
+        return StackStorage<Derived, T>::execute;
+    }
+    template <class Derived>
+    static constexpr StorageFunc storageFunc(heap_tag) noexcept
+    {
+        return AllocatedStorage<Derived, T, Alloc>::execute;
+    }
+
     template <class Derived, class... Args>
     void emplaceImpl(stack_tag, Args&&... args)
     {
+        static_assert(alignof(Derived) <= alignment, "stack buffer not aligned for Derived");
         void* stack = &m_stack;
         ::new (stack) Derived(std::forward<Args>(args)...);
         m_ptr = StackStorage<Derived, T>::execute;
+#ifdef SMALLPTR_ENABLE_STATS
+        SmallPtrStats::recordStack<Derived>();
+#endif
     }
     template <class Derived, class... Args>
     void emplaceImpl(heap_tag, Args&&... args)
     {
-        Derived* ptr = new Derived(std::forward<Args>(args)...);
-        storePtr<Derived>(ptr);
+        using Storage = AllocatedStorage<Derived, T, Alloc>;
+        Storage::create(&m_stack, get_allocator(), std::forward<Args>(args)...);
+        m_ptr = Storage::execute;
+#ifdef SMALLPTR_ENABLE_STATS
+        SmallPtrStats::recordHeap<Derived>(sizeof(typename Storage::Block));
+#endif
     }
 
+    /// emplaceStrong(): moves @a object to the heap, then replaces the current object by it
     template <class Derived>
-    void storePtr(Derived* ptr)
+    void replaceByHeap(Derived* object)
     {
+        using Storage = AllocatedStorage<Derived, T, Alloc>;
+        typename std::aligned_storage<sizeof(void*), alignof(void*)>::type block;
+        try
+        {
+            Storage::create(&block, get_allocator(), std::move(*object));
+        }
+        catch (...)
+        {
+            object->~Derived();
+            throw;
+        }
+        object->~Derived();
+        reset();
+        memcpy(&m_stack, &block, sizeof(void*));
+        m_ptr = Storage::execute;
+#ifdef SMALLPTR_ENABLE_STATS
+        SmallPtrStats::recordHeap<Derived>(sizeof(typename Storage::Block));
+#endif
+    }
+
+    template <class Derived>
+    SMALLPTR_CONSTEXPR void storePtr(Derived* ptr)
+    {
+        if (smallPtrConstantEvaluated())
+        {
+            m_stack.object = ptr;
+            m_ptr = ConstexprStorage<Derived, T>::execute;
+            return;
+        }
         m_ptr = HeapStorage<Derived, T>::execute;
         HeapStorage<Derived, T>::set(&m_stack, ptr);
     }
 
-    void assign(SmallPtr<T, T_StackSize>& rhs) /* noexcept */
+    static bool relocatable(StorageFunc func) noexcept
     {
-        if (rhs.m_ptr)
+        if (!func)
+            return true;
+        Params p;
+        func(Action::relocatable, p);
+        return p.relocatable.value;
+    }
+    static void relocate(StorageFunc func, void* from, void* to) /* noexcept */
+    {
+        if (func)
+        {
+            Params p;
+            p.moveTo.stackFrom = from;
+            p.moveTo.stackTo = to;
+            func(Action::move_to, p);
+        }
+    }
+
+    SMALLPTR_CONSTEXPR void assign(SmallPtr& rhs) /* noexcept */
+    {
+        if (smallPtrConstantEvaluated())
+        {
+            m_stack.object = rhs.m_stack.object;
+            m_ptr = rhs.m_ptr;
+            rhs.m_stack.object = nullptr;
+            rhs.m_ptr = nullptr;
+        }
+        else if (rhs.m_ptr)
         {
             Params p;
             p.moveTo.stackFrom = &rhs.m_stack;
             p.moveTo.stackTo = &m_stack;
             rhs.m_ptr(Action::move_to, p);
             m_ptr = rhs.m_ptr;
+            // the source has been destroyed by move_to
+            rhs.m_ptr = nullptr;
         }
-        rhs.reset();
     }
 };
 
-// generic swap specialization
-// template <class T, size_t N>
-// void swap(SmallPtr<T, N>& lhs, SmallPtr<T, N>& rhs)
-//{
-//    lhs.swap(rhs);
-//}
+// generic swap specialization (found by ADL, e.g. in std::iter_swap())
+template <class T, size_t N, class Alloc, size_t A>
+SMALLPTR_CONSTEXPR void swap(SmallPtr<T, N, Alloc, A>& lhs, SmallPtr<T, N, Alloc, A>& rhs)
+{
+    lhs.swap(rhs);
+}
 
 using std::swap;
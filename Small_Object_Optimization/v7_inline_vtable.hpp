@@ -0,0 +1,220 @@
+/**
+ * @file    v7_inline_vtable.hpp
+ * @brief   version 7 of SmallPtr: one pointer to a per-type table instead of an "execute" function
+ *
+ * The table makes get() a simple offset computation (stack) or a pointer load (heap), so the hot
+ * access path doesn't need any function call at all.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// per-type function table
+struct SmallVTable
+{
+    /// offset of the base class in the stack buffer (unused for heap objects)
+    std::ptrdiff_t offset;
+    void (*moveTo)(void* stackFrom, void* stackTo);
+    void (*destroy)(void* stack);
+    bool usesHeap;
+};
+
+template <class Derived, class Base>
+class InlineStackStorage
+{
+public:
+    /**
+     * The base class offset isn't a constant expression, so the table is created from the first
+     * constructed object. This is only done in emplace(), never when accessing the object.
+     */
+    static const SmallVTable* table(Derived* instance)
+    {
+        static const SmallVTable vtable{ reinterpret_cast<char*>(static_cast<Base*>(instance)) -
+                                           reinterpret_cast<char*>(instance),
+                                         &moveTo, &destroy, false };
+        return &vtable;
+    }
+
+    static void moveTo(void* stackFrom, void* stackTo)
+    {
+        Derived* fromPtr = std::launder(reinterpret_cast<Derived*>(stackFrom));
+        ::new (stackTo) Derived(std::move(*fromPtr));
+        fromPtr->~Derived();
+    }
+    static void destroy(void* stack) { std::launder(reinterpret_cast<Derived*>(stack))->~Derived(); }
+};
+
+/// the stack buffer holds a Base* (not Derived*), so accessing it doesn't need any adjustment
+template <class Derived, class Base>
+class InlineHeapStorage
+{
+public:
+    static void moveTo(void* stackFrom, void* stackTo)
+    {
+        memcpy(stackTo, stackFrom, sizeof(Base*));
+        set(stackFrom, nullptr);
+    }
+    static void destroy(void* stack)
+    {
+        Base* ptr;
+        memcpy(&ptr, stack, sizeof(ptr));
+        if (ptr)
+        {
+            delete static_cast<Derived*>(ptr);
+            set(stack, nullptr);
+        }
+    }
+    static void set(void* stack, Base* ptr) { memcpy(stack, &ptr, sizeof(ptr)); }
+
+    static constexpr SmallVTable vtable{ 0, &moveTo, &destroy, true };
+};
+
+/// dummy class that only transports type information
+template <class T>
+class InPlace
+{
+};
+
+template <class T, size_t T_StackSize = 64>
+class SmallPtr
+{
+private:
+    static_assert(!std::is_array<T>::value, "arrays not supported");
+    static_assert(T_StackSize >= sizeof(T*), "stack must at least hold a pointer");
+    static constexpr std::size_t alignment = alignof(void*);
+
+    const SmallVTable* m_vtable;
+    typename std::aligned_storage<T_StackSize, alignment>::type m_stack;
+
+    // tag dispatching
+    struct stack_tag
+    {
+    };
+    struct heap_tag
+    {
+    };
+
+    T* getPtr() const noexcept
+    {
+        if (!m_vtable)
+            return nullptr;
+        if (m_vtable->usesHeap)
+        {
+            T* ptr;
+            memcpy(&ptr, &m_stack, sizeof(ptr));
+            return ptr;
+        }
+        const char* stack = reinterpret_cast<const char*>(&m_stack);
+        return std::launder(reinterpret_cast<T*>(const_cast<char*>(stack) + m_vtable->offset));
+    }
+
+public:
+    SmallPtr() noexcept : m_vtable(nullptr) {}
+    explicit SmallPtr(T* ptr) noexcept : m_vtable(nullptr) { reset(ptr); }
+    ~SmallPtr() { reset(); }
+
+    template <class Derived, class... Args>
+    explicit SmallPtr(InPlace<Derived>, Args&&... args) : m_vtable(nullptr)
+    {
+        emplace<Derived>(std::forward<Args>(args)...);
+    }
+
+    SmallPtr(SmallPtr&& rhs) /* noexcept */ : m_vtable(nullptr) { assign(rhs); }
+    SmallPtr& operator=(SmallPtr&& rhs) /* noexcept */
+    {
+        if (this != &rhs)
+        {
+            reset();
+            assign(rhs);
+        }
+        return *this;
+    }
+    SmallPtr& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+    // disable copying
+    SmallPtr(const SmallPtr&) = delete;
+    SmallPtr& operator=(const SmallPtr&) = delete;
+
+    void reset(T* ptr = nullptr) noexcept
+    {
+        if (m_vtable)
+        {
+            m_vtable->destroy(&m_stack);
+            m_vtable = nullptr;
+        }
+        if (ptr)
+        {
+            InlineHeapStorage<T, T>::set(&m_stack, ptr);
+            m_vtable = &InlineHeapStorage<T, T>::vtable;
+        }
+    }
+
+    // access functions/operator
+    T* get() noexcept { return getPtr(); }
+    const T* get() const noexcept { return getPtr(); }
+
+    T* operator->() noexcept { return get(); }
+    const T* operator->() const noexcept { return get(); }
+
+    T& operator*() noexcept { return *get(); }
+    const T& operator*() const noexcept { return *get(); }
+
+    // check functions
+    bool operator==(std::nullptr_t) const noexcept { return get() == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return get() != nullptr; }
+    explicit operator bool() const noexcept { return *this != nullptr; }
+
+    bool usesHeap() const noexcept { return m_vtable && m_vtable->usesHeap; }
+    bool usesStack() const noexcept { return !usesHeap(); }
+
+    template <class Derived, class... Args>
+    void emplace(Args&&... args)
+    {
+        static_assert(std::is_same<T, Derived>::value or std::is_base_of<T, Derived>::value,
+                      "may only use sub-classes of T!");
+        static_assert(std::is_constructible<Derived, Args...>::value, "cannot instantiate!");
+
+        reset();
+        constexpr bool smallFit = (sizeof(Derived) <= T_StackSize) &&
+                                  (alignof(Derived) <= alignment) &&
+                                  std::is_move_constructible<Derived>::value;
+        emplaceImpl<Derived>(std::conditional_t<smallFit, stack_tag, heap_tag>{},
+                             std::forward<Args>(args)...);
+    }
+
+private:
+    template <class Derived, class... Args>
+    void emplaceImpl(stack_tag, Args&&... args)
+    {
+        void* stack = &m_stack;
+        Derived* ptr = ::new (stack) Derived(std::forward<Args>(args)...);
+        m_vtable = InlineStackStorage<Derived, T>::table(ptr);
+    }
+    template <class Derived, class... Args>
+    void emplaceImpl(heap_tag, Args&&... args)
+    {
+        T* ptr = new Derived(std::forward<Args>(args)...);
+        InlineHeapStorage<Derived, T>::set(&m_stack, ptr);
+        m_vtable = &InlineHeapStorage<Derived, T>::vtable;
+    }
+
+    void assign(SmallPtr& rhs) /* noexcept */
+    {
+        if (rhs.m_vtable)
+        {
+            rhs.m_vtable->moveTo(&rhs.m_stack, &m_stack);
+            m_vtable = rhs.m_vtable;
+            rhs.m_vtable = nullptr;
+        }
+    }
+};
+
+using std::swap;